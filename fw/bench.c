@@ -0,0 +1,364 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/structs/bus_ctrl.h"
+#include "hardware/structs/systick.h"
+#include "lcd.h"
+#include "gfx.h"
+#include "ui.h"
+#include "syslog.h"
+#include "fmt.h"
+#include "memstat.h"
+#include "bench.h"
+
+#if defined(LCD_LINE_MODE) && (defined(BENCH_GFX) || defined(BENCH_TEXT))
+#error "BENCH_GFX and BENCH_TEXT need a framebuffer"
+#endif
+#if defined(LCD_INDEXED) && defined(BENCH_GFX)
+#error "BENCH_GFX compares the RGB565 paths"
+#endif
+
+#ifdef BENCH_BUS_CONTENTION
+#define BENCH_BUS_SCRATCH_SIZE (1024)
+
+static uint32_t bench_src[BENCH_BUS_SCRATCH_SIZE / 4];
+static uint32_t bench_dst[BENCH_BUS_SCRATCH_SIZE / 4];
+
+static void bench_bus_counters_reset(void) {
+    bus_ctrl_hw->counter[0].sel = arbiter_sram0_perf_event_access_contested;
+    bus_ctrl_hw->counter[1].sel = arbiter_sram1_perf_event_access_contested;
+    bus_ctrl_hw->counter[2].sel = arbiter_sram2_perf_event_access_contested;
+    bus_ctrl_hw->counter[3].sel = arbiter_sram3_perf_event_access_contested;
+    for (int i = 0; i < 4; i++)
+        bus_ctrl_hw->counter[i].value = 0;
+}
+
+// Copy the scratch buffer back and forth the given number of times, return
+// the elapsed time in us.
+static uint32_t bench_bus_workload(int iterations) {
+    uint32_t start = time_us_32();
+    for (int i = 0; i < iterations; i++) {
+        memcpy(bench_dst, bench_src, BENCH_BUS_SCRATCH_SIZE);
+        memcpy(bench_src, bench_dst, BENCH_BUS_SCRATCH_SIZE);
+    }
+    return time_us_32() - start;
+}
+
+static void bench_bus_contention(void) {
+    uint32_t contested[4];
+
+    while (lcd_is_busy())
+        lcd_poll();
+
+    // Run the workload for as long as one full frame DMA takes
+    bench_bus_counters_reset();
+    uint32_t start = time_us_32();
+    lcd_update();
+    int iterations = 0;
+    while (lcd_is_busy()) {
+        lcd_poll();
+        bench_bus_workload(1);
+        iterations++;
+    }
+    uint32_t time_dma = time_us_32() - start;
+    for (int i = 0; i < 4; i++)
+        contested[i] = bus_ctrl_hw->counter[i].value;
+
+    // Same amount of work with the bus to ourselves
+    uint32_t time_idle = bench_bus_workload(iterations);
+
+    syslog_printf("BUS: %d it, %d us w/ DMA, %d us idle",
+            iterations, time_dma, time_idle);
+    syslog_printf("BUS: contested %d %d %d %d",
+            contested[0], contested[1], contested[2], contested[3]);
+}
+#endif
+
+#ifdef BENCH_LCD_PUSH
+static void bench_lcd_push(void) {
+    uint32_t start = time_us_32();
+    for (int i = 0; i < BENCH_LCD_PUSH_FRAMES; i++) {
+        lcd_update();
+        while (lcd_is_busy())
+            lcd_poll();
+    }
+    uint32_t elapsed = time_us_32() - start;
+
+    const lcd_stats_t *stats = lcd_get_stats();
+    syslog_printf("LCD: SPI %d kHz, %d frames in %d us",
+            stats->spi_freq / 1000, BENCH_LCD_PUSH_FRAMES, elapsed);
+    syslog_printf("LCD: push %d us (max %d), ISR max %d us",
+            stats->push_us, stats->push_us_max, stats->isr_us_max);
+    if (stats->unpaced)
+        syslog_printf("LCD: %d frames unpaced, no alarm", stats->unpaced);
+#if defined(LCD_LINE_MODE) || defined(LCD_INDEXED)
+    // The line interrupt has to render a line within one line time
+    syslog_printf("LCD: line time %d ns",
+            (uint32_t)((uint64_t)LCD_WIDTH * 16 * 1000000000 / stats->spi_freq));
+#endif
+}
+#endif
+
+#if defined(BENCH_GFX) || defined(BENCH_SYSLOG) || defined(BENCH_FMT)
+// SysTick on the processor clock, 24 bits is plenty for a single frame
+static void bench_cycles_start(void) {
+    systick_hw->csr = 0x5;
+    systick_hw->rvr = 0x00ffffff;
+    systick_hw->cvr = 0;
+}
+
+static uint32_t bench_cycles(void) {
+    return (0x00ffffff - systick_hw->cvr) & 0x00ffffff;
+}
+#endif
+
+#ifdef BENCH_GFX
+// The loops gfx replaced
+static void bench_cpu_fill(const lcd_rect_t *r, uint16_t c) {
+    for (int y = r->y1; y <= r->y2; y++)
+        for (int x = r->x1; x <= r->x2; x++)
+            framebuffer[y * LCD_WIDTH + x] = c;
+}
+
+static void bench_cpu_copy(const lcd_rect_t *r, int dx, int dy) {
+    for (int y = r->y1; y <= r->y2; y++)
+        memmove(&framebuffer[(y + dy) * LCD_WIDTH + r->x1 + dx],
+                &framebuffer[y * LCD_WIDTH + r->x1], (r->x2 - r->x1 + 1) * 2);
+}
+
+// Report CPU loop cycles, cycles until the DMA version returns control, and
+// cycles until it completes
+static void bench_gfx_report(const char *name, uint32_t cpu, uint32_t issue,
+        uint32_t done) {
+    syslog_printf("GFX %s: cpu %d, dma %d/%d",
+            name, cpu / BENCH_GFX_ROUNDS, issue / BENCH_GFX_ROUNDS,
+            done / BENCH_GFX_ROUNDS);
+}
+
+static void bench_gfx(void) {
+    const lcd_rect_t full = {0, 0, LCD_WIDTH - 1, LCD_HEIGHT - 1};
+    const lcd_rect_t region = {1, 8, LCD_WIDTH / 2, LCD_HEIGHT / 2};
+    const lcd_rect_t scroll = {0, 8, LCD_WIDTH - 1, LCD_HEIGHT - 1};
+    const lcd_rect_t *rects[3] = {&full, &region, &scroll};
+    const char *names[3] = {"clear", "region", "scroll"};
+    uint32_t cpu, issue, done;
+
+    while (lcd_is_busy())
+        lcd_poll();
+
+    for (int t = 0; t < 3; t++) {
+        cpu = issue = done = 0;
+        for (int i = 0; i < BENCH_GFX_ROUNDS; i++) {
+            bench_cycles_start();
+            if (t == 2)
+                bench_cpu_copy(rects[t], 0, -8);
+            else
+                bench_cpu_fill(rects[t], i);
+            cpu += bench_cycles();
+
+            bench_cycles_start();
+            if (t == 2)
+                gfx_copy(rects[t], 0, 0);
+            else
+                gfx_fill(rects[t], i);
+            issue += bench_cycles();
+            gfx_wait();
+            done += bench_cycles();
+        }
+        bench_gfx_report(names[t], cpu, issue, done);
+    }
+}
+#endif
+
+#ifdef BENCH_TEXT
+#include "font.h"
+
+// The per-pixel renderer the glyph cache replaced
+static void bench_text_old_char(int x, int y, char c, uint16_t cl) {
+    c -= 0x20;
+    for (int yy = 0; yy < 7; yy++) {
+        if ((y + yy) < 0) continue;
+        if ((y + yy) >= UI_HEIGHT) continue;
+        for (int xx = 0; xx < 5; xx++) {
+            if ((x + xx) < 0) continue;
+            if ((x + xx) >= UI_WIDTH) continue;
+            uint16_t p = ((font[c * 5 + xx] >> yy) & 0x01) ? cl : 0x0000;
+#ifdef ROTATE_UI
+            lcd_fb_put((x + xx) * LCD_WIDTH + (LCD_WIDTH - 1 - (y + yy)),
+                    LCD_FB_COLOR(p));
+#else
+            lcd_fb_put((y + yy) * LCD_WIDTH + (x + xx), LCD_FB_COLOR(p));
+#endif
+        }
+    }
+}
+
+static void bench_text_report(const char *name, int chars, uint32_t us) {
+    syslog_printf("TEXT %s: %d chars in %d us, %d char/s", name, chars, us,
+            (uint32_t)((uint64_t)chars * 1000000 / us));
+}
+
+static void bench_text(void) {
+    static char line[UI_WIDTH / 6 + 1];
+    int len = UI_WIDTH / 6;
+    int lines = UI_HEIGHT / 8;
+    int chars = len * lines * BENCH_TEXT_ROUNDS;
+    uint32_t start;
+
+    for (int i = 0; i < len; i++)
+        line[i] = 0x21 + i;
+    line[len] = 0;
+
+    while (lcd_is_busy())
+        lcd_poll();
+
+    start = time_us_32();
+    for (int r = 0; r < BENCH_TEXT_ROUNDS; r++)
+        for (int y = 0; y < lines; y++)
+            for (int i = 0; i < len; i++)
+                bench_text_old_char(i * 6, y * 8, line[i], 0xffff);
+    bench_text_report("pixel", chars, time_us_32() - start);
+
+    start = time_us_32();
+    for (int r = 0; r < BENCH_TEXT_ROUNDS; r++)
+        for (int y = 0; y < lines; y++)
+            for (int i = 0; i < len; i++)
+                ui_disp_char(i * 6, y * 8, line[i], 0xffff);
+    bench_text_report("glyph", chars, time_us_32() - start);
+
+    start = time_us_32();
+    for (int r = 0; r < BENCH_TEXT_ROUNDS; r++)
+        for (int y = 0; y < lines; y++)
+            ui_disp_string(0, y * 8, line, 0xffff);
+    bench_text_report("string", chars, time_us_32() - start);
+}
+#endif
+
+#ifdef BENCH_SYSLOG
+// Calls per round, small enough for the deferred ring to take them all
+#define BENCH_SYSLOG_CALLS (SYSLOG_REC_RING_SIZE / 2)
+
+// Cycles per call of a logged, a runtime masked and a compiled out message,
+// against formatting right away with syslog_printf(). The last one is only
+// compiled out while SYSLOG_LEVEL_UI is below SYSLOG_DEBUG.
+static void bench_syslog(void) {
+    uint32_t logged = 0, masked = 0, off = 0, direct = 0;
+    uint8_t mask = syslog_mask[SYSLOG_MOD_UI];
+
+    syslog_flush();
+    for (int r = 0; r < BENCH_SYSLOG_ROUNDS; r++) {
+        syslog_set_mask(SYSLOG_MOD_UI, 0xff);
+        bench_cycles_start();
+        for (int i = 0; i < BENCH_SYSLOG_CALLS; i++)
+            SYSLOG(UI, SYSLOG_ERR, "bench %d %d", r, i);
+        logged += bench_cycles();
+        syslog_flush();
+
+        syslog_set_mask(SYSLOG_MOD_UI, 0);
+        bench_cycles_start();
+        for (int i = 0; i < BENCH_SYSLOG_CALLS; i++)
+            SYSLOG(UI, SYSLOG_ERR, "bench %d %d", r, i);
+        masked += bench_cycles();
+
+        bench_cycles_start();
+        for (int i = 0; i < BENCH_SYSLOG_CALLS; i++)
+            SYSLOG(UI, SYSLOG_DEBUG, "bench %d %d", r, i);
+        off += bench_cycles();
+        syslog_set_mask(SYSLOG_MOD_UI, mask);
+
+        bench_cycles_start();
+        for (int i = 0; i < BENCH_SYSLOG_CALLS; i++)
+            syslog_printf("bench %d %d", r, i);
+        direct += bench_cycles();
+    }
+
+    int calls = BENCH_SYSLOG_ROUNDS * BENCH_SYSLOG_CALLS;
+    syslog_printf("SYSLOG: %d cyc logged, %d masked, %d off, %d direct",
+            logged / calls, masked / calls, off / calls, direct / calls);
+}
+#endif
+
+#ifdef BENCH_FMT
+// Bytes below the current frame painted before a call and checked after
+#define BENCH_FMT_STACK_SIZE (1024)
+
+typedef int (*bench_fmt_fn_t)(char *buf, size_t size, const char *format,
+        ...);
+
+// Cycles per call over all the formats, and the stack used by one call with
+// the longest of them
+static void bench_fmt_run(const char *name, bench_fmt_fn_t fn) {
+    char buf[SYSLOG_PRINTF_BUFFER_SIZE];
+    uint32_t cycles = 0;
+    volatile uint32_t *sp = __builtin_frame_address(0);
+    int i;
+
+    for (int r = 0; r < BENCH_FMT_ROUNDS; r++) {
+        bench_cycles_start();
+        fn(buf, sizeof(buf), "CC status %d %d", r, 3);
+        fn(buf, sizeof(buf), "RECV %04x/%d ", 0x11a1 + r, 2);
+        fn(buf, sizeof(buf), "VDM %08x %08x", 0xff018043u, r);
+        fn(buf, sizeof(buf), "[%d]%s", 123456789 + r, "DP enabled");
+        fn(buf, sizeof(buf), "%d", -r);
+        cycles += bench_cycles();
+    }
+
+    for (i = 1; i < BENCH_FMT_STACK_SIZE / 4; i++)
+        sp[-i] = MEMSTAT_STACK_PAINT;
+    fn(buf, sizeof(buf), "[%d]%s %08x", 123456789, "DP enabled", 0xff018043u);
+    for (i = BENCH_FMT_STACK_SIZE / 4 - 1; i > 0; i--)
+        if (sp[-i] != MEMSTAT_STACK_PAINT)
+            break;
+
+    syslog_printf("%s: %d cyc/call, %d B stack", name,
+            cycles / (BENCH_FMT_ROUNDS * 5), i * 4);
+}
+
+static void bench_fmt(void) {
+    bench_fmt_run("snprintf", snprintf);
+    bench_fmt_run("fmt_snprintf", fmt_snprintf);
+}
+#endif
+
+void bench_run(void) {
+#ifdef BENCH_BUS_CONTENTION
+    bench_bus_contention();
+#endif
+#ifdef BENCH_LCD_PUSH
+    bench_lcd_push();
+#endif
+#ifdef BENCH_GFX
+    bench_gfx();
+#endif
+#ifdef BENCH_TEXT
+    bench_text();
+#endif
+#ifdef BENCH_SYSLOG
+    bench_syslog();
+#endif
+#ifdef BENCH_FMT
+    bench_fmt();
+#endif
+}
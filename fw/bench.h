@@ -0,0 +1,54 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#pragma once
+
+// On-target benchmarks, run once at boot before PD is brought up. Results go
+// to the syslog. Leave all of them disabled for normal builds.
+
+// CPU memory traffic vs. a full-frame LCD DMA, using the bus perf counters.
+// Build once with FW_SRAM_BANKED on and once off to compare the layouts.
+//#define BENCH_BUS_CONTENTION
+
+// Push full frames back to back and report the LCD transfer statistics
+//#define BENCH_LCD_PUSH
+#define BENCH_LCD_PUSH_FRAMES (32)
+
+// DMA fill/copy primitives against the equivalent CPU loops, in cycles
+//#define BENCH_GFX
+#define BENCH_GFX_ROUNDS (8)
+
+// Text drawing throughput: the old per-pixel loop, single glyphs and whole
+// strings, in characters per second
+//#define BENCH_TEXT
+#define BENCH_TEXT_ROUNDS (64)
+
+// Cycles per SYSLOG() call: logged, masked at runtime, compiled out, and
+// syslog_printf() for comparison
+//#define BENCH_SYSLOG
+#define BENCH_SYSLOG_ROUNDS (8)
+
+// fmt_snprintf() against the SDK's snprintf(), in cycles and stack bytes per
+// call on a few of the formats the firmware logs
+//#define BENCH_FMT
+#define BENCH_FMT_ROUNDS (64)
+
+void bench_run(void);
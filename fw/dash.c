@@ -0,0 +1,181 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "lcd.h"
+#include "ui.h"
+#include "fmt.h"
+#include "dash.h"
+
+#ifdef LARGE_UI
+#error "The dashboard needs the text UI"
+#endif
+
+#define DASH_LABEL_CHARS (5)
+#define DASH_FIELD_CHARS (12)
+
+// Labels go left of the values if the line is wide enough, above them if not
+#if UI_WIDTH >= (DASH_LABEL_CHARS + DASH_FIELD_CHARS) * 6
+#define DASH_VALUE_X (DASH_LABEL_CHARS * 6)
+#define DASH_VALUE_DY (0)
+#define DASH_ROW_H (10)
+#else
+#define DASH_VALUE_X (0)
+#define DASH_VALUE_DY (8)
+#define DASH_ROW_H (18)
+#endif
+// First row, below the title
+#define DASH_TOP (12)
+
+#define DASH_FG     (0xffff)
+#define DASH_DIM    (0x7bef)
+#define DASH_GOOD   (0x07e0)
+#define DASH_BAD    (0xf800)
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    uint16_t color;
+    char text[DASH_FIELD_CHARS];    // As last drawn, space padded
+} dash_widget_t;
+
+enum {
+    DASH_CONTRACT = 0,
+    DASH_ROLE,
+    DASH_DP,
+    DASH_HPD,
+    DASH_PTN3460,
+    DASH_UPTIME,
+    DASH_WIDGETS
+};
+
+static const char *const dash_labels[DASH_WIDGETS] = {
+    "PD", "Role", "DP", "HPD", "LVDS", "Up"
+};
+
+static dash_widget_t dash_widgets[DASH_WIDGETS];
+static absolute_time_t dash_deadline;
+
+// Redraw the characters of a widget that differ from what is on screen, in
+// runs, or all of them if the colour changed
+static void dash_draw(dash_widget_t *w, const char *text, uint16_t color) {
+    bool all = (color != w->color);
+    char run[DASH_FIELD_CHARS + 1];
+    int i = 0;
+
+    w->color = color;
+    while (i < DASH_FIELD_CHARS) {
+        if (!all && (text[i] == w->text[i])) {
+            i++;
+            continue;
+        }
+        int n = 0;
+        while ((i + n < DASH_FIELD_CHARS) &&
+                (all || (text[i + n] != w->text[i + n]))) {
+            run[n] = text[i + n];
+            n++;
+        }
+        run[n] = '\0';
+        ui_disp_string(w->x + i * 6, w->y, run, color);
+        memcpy(&w->text[i], run, n);
+        i += n;
+    }
+}
+
+static void dash_set(int id, uint16_t color, const char *format, ...)
+        __attribute__((format(gnu_printf, 3, 4)));
+
+static void dash_set(int id, uint16_t color, const char *format, ...) {
+    char text[DASH_FIELD_CHARS + 1];
+    va_list args;
+
+    va_start(args, format);
+    int n = fmt_vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (n > DASH_FIELD_CHARS)
+        n = DASH_FIELD_CHARS;
+    memset(&text[n], ' ', DASH_FIELD_CHARS - n);
+    dash_draw(&dash_widgets[id], text, color);
+}
+
+// Take over the screen and draw the labels. The values are drawn by the
+// first dash_update().
+void dash_init(void) {
+    ui_clear(0x0000);
+    ui_disp_string(0, 0, "Status", DASH_FG);
+    for (int i = 0; i < DASH_WIDGETS; i++) {
+        dash_widget_t *w = &dash_widgets[i];
+        int y = DASH_TOP + i * DASH_ROW_H;
+        ui_disp_string(0, y, (char *)dash_labels[i], DASH_DIM);
+        w->x = DASH_VALUE_X;
+        w->y = y + DASH_VALUE_DY;
+        // Nothing drawn yet, never matches a padded field
+        memset(w->text, 0, sizeof(w->text));
+        w->color = DASH_FG;
+    }
+    ui_update();
+    dash_deadline = get_absolute_time();
+}
+
+// True once every 1 / DASH_RATE_HZ seconds
+bool dash_due(void) {
+    if (!time_reached(dash_deadline))
+        return false;
+    dash_deadline = make_timeout_time_ms(1000 / DASH_RATE_HZ);
+    return true;
+}
+
+void dash_update(const dash_status_t *s) {
+    if (!s->attached)
+        dash_set(DASH_CONTRACT, DASH_DIM, "detached");
+    else if (!s->contract)
+        dash_set(DASH_CONTRACT, DASH_DIM, "no contract");
+    else
+        dash_set(DASH_CONTRACT, DASH_FG, "%u.%02uV %u.%02uA",
+                s->mv / 1000, (s->mv % 1000) / 10,
+                s->ma / 1000, (s->ma % 1000) / 10);
+
+    if (s->attached)
+        dash_set(DASH_ROLE, DASH_FG, "%s %s CC%d", s->source ? "SRC" : "SNK",
+                s->dfp ? "DFP" : "UFP", s->polarity + 1);
+    else
+        dash_set(DASH_ROLE, DASH_DIM, "-");
+
+    if (s->dp_pin)
+        dash_set(DASH_DP, DASH_GOOD, "pin %c", s->dp_pin);
+    else
+        dash_set(DASH_DP, DASH_DIM, "off");
+
+    dash_set(DASH_HPD, s->hpd ? DASH_GOOD : DASH_DIM, "%s",
+            s->hpd ? "high" : "low");
+    dash_set(DASH_PTN3460, s->ptn3460_up ? DASH_GOOD : DASH_BAD, "%s",
+            s->ptn3460_up ? "up" : "down");
+
+    uint32_t t = to_ms_since_boot(get_absolute_time()) / 100;
+    dash_set(DASH_UPTIME, DASH_FG, "%u:%02u:%02u.%u", t / 36000,
+            (t / 600) % 60, (t / 10) % 60, t % 10);
+
+    ui_update();
+}
@@ -0,0 +1,51 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Status dashboard, in place of the scrolling system log. Every value is a
+// retained widget that remembers the text it last drew. An update only
+// redraws the characters that changed, so a frame where only the uptime
+// ticks sends one or two glyph cells (under 100 bytes each) to the LCD
+// instead of the whole screen. The log is still collected, streamed and
+// kept in flash, it is just not shown.
+//#define DASH_ENABLE
+#define DASH_RATE_HZ (10)
+
+typedef struct {
+    bool attached;
+    bool contract;          // Explicit contract, mv and ma are valid
+    uint32_t mv;
+    uint32_t ma;
+    bool source;            // Power role
+    bool dfp;               // Data role
+    int polarity;           // CC line in use, 0 for CC1
+    char dp_pin;            // DP pin assignment 'A'-'F', 0 if not configured
+    bool hpd;               // HPD high sent to the source
+    bool ptn3460_up;
+} dash_status_t;
+
+void dash_init(void);
+bool dash_due(void);
+void dash_update(const dash_status_t *s);
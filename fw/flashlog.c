@@ -0,0 +1,295 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <stdint.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/watchdog.h"
+#include "flashlog.h"
+#include "syslog.h"
+#include "trace.h"
+#include "usb_pd.h"
+
+#define FLASHLOG_PAGES (FLASHLOG_SIZE / FLASH_PAGE_SIZE)
+#define FLASHLOG_PAGES_PER_SECTOR (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE)
+#define FLASHLOG_MAX_PAYLOAD (FLASH_PAGE_SIZE - sizeof(flashlog_page_t) - \
+        sizeof(flashlog_entry_t))
+
+_Static_assert(sizeof(flashlog_crash_t) <= FLASHLOG_MAX_PAYLOAD,
+        "Crash record does not fit in a page");
+_Static_assert((FLASHLOG_OFFSET % FLASH_SECTOR_SIZE) == 0,
+        "Log region must be sector aligned");
+
+// Pages waiting to be programmed, each starts with a flashlog_page_t
+static uint8_t page_buf[FLASHLOG_PAGE_BUFFERS][FLASH_PAGE_SIZE]
+        __attribute__((aligned(4)));
+static uint32_t buf_rd;     // Oldest full page
+static uint32_t buf_wr;     // Page being filled
+static uint32_t fill;       // Bytes used in the page being filled
+static uint32_t fill_time;  // When its first entry went in, us
+
+static uint32_t next_page;  // Index of the next page to program
+static uint32_t next_seq;
+static bool next_erased;    // Sector holding next_page is erased
+
+static flashlog_stats_t stats;
+static bool ready;
+
+static const uint8_t *flashlog_page(uint32_t index) {
+    return (const uint8_t *)(XIP_NOCACHE_NOALLOC_BASE + FLASHLOG_OFFSET +
+            index * FLASH_PAGE_SIZE);
+}
+
+static bool flashlog_page_valid(uint32_t index) {
+    const flashlog_page_t *hdr = (const flashlog_page_t *)flashlog_page(index);
+    return hdr->magic == FLASHLOG_MAGIC;
+}
+
+static bool flashlog_blank(const uint8_t *p, uint32_t size) {
+    const uint32_t *w = (const uint32_t *)p;
+    for (uint32_t i = 0; i < size / 4; i++)
+        if (w[i] != 0xffffffff)
+            return false;
+    return true;
+}
+
+// Program or erase with nothing running from flash: interrupts off here and
+// the other core parked in RAM if it is running.
+static void flashlog_flash_op(uint32_t index, const uint8_t *data) {
+    bool lockout = multicore_lockout_victim_is_initialized(1);
+    if (lockout)
+        multicore_lockout_start_blocking();
+    uint32_t save = save_and_disable_interrupts();
+    uint32_t offset = FLASHLOG_OFFSET + index * FLASH_PAGE_SIZE;
+    if (data)
+        flash_range_program(offset, data, FLASH_PAGE_SIZE);
+    else
+        flash_range_erase(offset, FLASH_SECTOR_SIZE);
+    restore_interrupts(save);
+    if (lockout)
+        multicore_lockout_end_blocking();
+}
+
+// One flash operation towards programming the oldest full page, false if
+// there is nothing to do
+static bool flashlog_step(void) {
+    if (buf_rd == buf_wr)
+        return false;
+    if (!next_erased) {
+        flashlog_flash_op(next_page, NULL);
+        stats.erases++;
+        next_erased = true;
+        return true;
+    }
+    uint8_t *page = page_buf[buf_rd % FLASHLOG_PAGE_BUFFERS];
+    flashlog_page_t *hdr = (flashlog_page_t *)page;
+    hdr->seq = next_seq++;
+    flashlog_flash_op(next_page, page);
+    stats.pages++;
+    buf_rd++;
+    next_page = (next_page + 1) % FLASHLOG_PAGES;
+    if ((next_page % FLASHLOG_PAGES_PER_SECTOR) == 0)
+        next_erased = false;
+    return true;
+}
+
+static void flashlog_open_page(void) {
+    uint8_t *page = page_buf[buf_wr % FLASHLOG_PAGE_BUFFERS];
+    flashlog_page_t *hdr = (flashlog_page_t *)page;
+    memset(page, 0xff, FLASH_PAGE_SIZE);
+    hdr->magic = FLASHLOG_MAGIC;
+    hdr->boot = stats.boot;
+    hdr->reserved = 0;
+    fill = sizeof(flashlog_page_t);
+}
+
+// Queue the page being filled for programming, false if all buffers are
+// taken
+static bool flashlog_close_page(void) {
+    if ((buf_wr + 1 - buf_rd) >= FLASHLOG_PAGE_BUFFERS)
+        return false;
+    buf_wr++;
+    flashlog_open_page();
+    return true;
+}
+
+void flashlog_write(flashlog_type_t type, uint32_t time, const void *data,
+        int length) {
+    if (!ready)
+        return;
+    if (length > (int)FLASHLOG_MAX_PAYLOAD)
+        length = FLASHLOG_MAX_PAYLOAD;
+    uint32_t size = (sizeof(flashlog_entry_t) + length + 3) & ~3u;
+    if ((fill + size > FLASH_PAGE_SIZE) && !flashlog_close_page()) {
+        stats.dropped++;
+        return;
+    }
+    if (fill == sizeof(flashlog_page_t))
+        fill_time = time_us_32();
+    uint8_t *page = page_buf[buf_wr % FLASHLOG_PAGE_BUFFERS];
+    flashlog_entry_t *entry = (flashlog_entry_t *)&page[fill];
+    entry->type = type;
+    entry->length = length;
+    entry->reserved = 0;
+    entry->time = time;
+    memcpy(entry + 1, data, length);
+    fill += size;
+}
+
+void flashlog_poll(bool idle) {
+    if (!ready)
+        return;
+    if ((fill > sizeof(flashlog_page_t)) &&
+            ((time_us_32() - fill_time) >= FLASHLOG_FLUSH_MS * 1000))
+        flashlog_close_page();
+    // At most one flash operation per call
+    if (idle)
+        flashlog_step();
+}
+
+void flashlog_crash(const char *reason) {
+    flashlog_crash_t crash;
+    trace_event_t events[FLASHLOG_CRASH_TRACE];
+
+    if (!ready)
+        return;
+    memset(&crash, 0, sizeof(crash));
+    for (int i = 0; i < 8; i++)
+        crash.scratch[i] = watchdog_hw->scratch[i];
+    crash.pd_flags = pd_get_flags(0);
+    crash.pd_state = pd_get_task_state(0);
+    crash.pd_polarity = pd_get_polarity(0);
+    crash.pd_vdm_busy = pd_is_vdm_busy(0);
+    crash.trace_count = trace_snapshot(events, FLASHLOG_CRASH_TRACE);
+    memcpy(crash.trace, events, crash.trace_count * sizeof(trace_event_t));
+    strncpy(crash.reason, reason, FLASHLOG_REASON_SIZE - 1);
+
+    // Make room if the buffers are full, this is the record that matters
+    if ((buf_wr + 1 - buf_rd) >= FLASHLOG_PAGE_BUFFERS)
+        while (buf_rd != buf_wr)
+            flashlog_step();
+    flashlog_write(FLASHLOG_CRASH, time_us_32(), &crash, sizeof(crash));
+    if (fill > sizeof(flashlog_page_t))
+        flashlog_close_page();
+    while (flashlog_step())
+        ;
+}
+
+// Report the crash records left by the previous boot
+static void flashlog_report(uint32_t newest) {
+    uint32_t boot = ((const flashlog_page_t *)flashlog_page(newest))->boot;
+    uint32_t index = newest;
+
+    // Walk back to the first page of that boot
+    for (uint32_t i = 1; i < FLASHLOG_PAGES; i++) {
+        uint32_t prev = (newest + FLASHLOG_PAGES - i) % FLASHLOG_PAGES;
+        const flashlog_page_t *hdr = (const flashlog_page_t *)flashlog_page(prev);
+        if (!flashlog_page_valid(prev) || (hdr->boot != boot))
+            break;
+        index = prev;
+    }
+
+    for (;;) {
+        const uint8_t *page = flashlog_page(index);
+        uint32_t pos = sizeof(flashlog_page_t);
+        while (pos + sizeof(flashlog_entry_t) <= FLASH_PAGE_SIZE) {
+            const flashlog_entry_t *entry = (const flashlog_entry_t *)&page[pos];
+            if (entry->type == FLASHLOG_END)
+                break;
+            if ((entry->type == FLASHLOG_CRASH) &&
+                    (entry->length >= sizeof(flashlog_crash_t))) {
+                const flashlog_crash_t *crash =
+                        (const flashlog_crash_t *)(entry + 1);
+                char reason[FLASHLOG_REASON_SIZE];
+                strncpy(reason, crash->reason, FLASHLOG_REASON_SIZE - 1);
+                reason[FLASHLOG_REASON_SIZE - 1] = '\0';
+                syslog_printf("Boot %d crashed at %d ms: %s", boot,
+                        entry->time / 1000, reason);
+                syslog_printf("PD st %d flags %08x pol %d vdm %d",
+                        crash->pd_state, crash->pd_flags, crash->pd_polarity,
+                        crash->pd_vdm_busy);
+            }
+            pos += (sizeof(flashlog_entry_t) + entry->length + 3) & ~3u;
+        }
+        if (index == newest)
+            break;
+        index = (index + 1) % FLASHLOG_PAGES;
+    }
+}
+
+void flashlog_init(void) {
+    uint32_t newest = 0;
+    bool found = false;
+
+    // The newest page has the highest sequence number
+    for (uint32_t i = 0; i < FLASHLOG_PAGES; i++) {
+        if (!flashlog_page_valid(i))
+            continue;
+        const flashlog_page_t *hdr = (const flashlog_page_t *)flashlog_page(i);
+        if (!found || ((int32_t)(hdr->seq - next_seq) >= 0)) {
+            newest = i;
+            next_seq = hdr->seq + 1;
+            found = true;
+        }
+    }
+
+    if (found) {
+        stats.boot = ((const flashlog_page_t *)flashlog_page(newest))->boot + 1;
+        next_page = (newest + 1) % FLASHLOG_PAGES;
+    } else {
+        stats.boot = 0;
+        next_seq = 0;
+        next_page = 0;
+    }
+    // Pages after the newest one in its sector were erased with it. Start a
+    // fresh sector if that does not hold.
+    if ((next_page % FLASHLOG_PAGES_PER_SECTOR) == 0) {
+        next_erased = flashlog_blank(flashlog_page(next_page),
+                FLASH_SECTOR_SIZE);
+    } else if (!flashlog_blank(flashlog_page(next_page), FLASH_PAGE_SIZE)) {
+        next_page = (next_page + FLASHLOG_PAGES_PER_SECTOR - 1) /
+                FLASHLOG_PAGES_PER_SECTOR * FLASHLOG_PAGES_PER_SECTOR %
+                FLASHLOG_PAGES;
+        next_erased = false;
+    } else {
+        next_erased = true;
+    }
+
+    buf_rd = buf_wr = 0;
+    flashlog_open_page();
+    ready = true;
+
+    if (found)
+        flashlog_report(newest);
+
+    flashlog_boot_t boot;
+    boot.watchdog_reboot = watchdog_caused_reboot();
+    for (int i = 0; i < 8; i++)
+        boot.scratch[i] = watchdog_hw->scratch[i];
+    flashlog_write(FLASHLOG_BOOT, time_us_32(), &boot, sizeof(boot));
+}
+
+const flashlog_stats_t *flashlog_get_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,108 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "trace.h"
+
+// Persistent log at the end of the external flash. The region is a ring of
+// 256-byte pages that are programmed once each, in order, and a 4 KB sector
+// is erased just before the ring enters it again, so every sector sees the
+// same number of erases. Each page starts with a header carrying a
+// sequence number, the newest page is the one with the highest.
+//
+// Entries are collected into RAM page buffers and programmed a whole page at
+// a time from flashlog_poll(), only when the caller says the system is idle:
+// programming a page stalls XIP for about 1 ms and erasing a sector for
+// about 50 ms, with interrupts off on this core and the other core locked
+// out. A partly filled page is programmed after FLASHLOG_FLUSH_MS.
+//
+// flashlog_crash(), called from fatal(), writes a crash record and programs
+// everything pending right away. flashlog_init() reports the crash records
+// of the previous boot in the syslog. tools/flashlog.py decodes a dump of
+// the region read back with picotool.
+
+#define FLASHLOG_FLASH_SIZE     (16 * 1024 * 1024)  // W25Q128
+#define FLASHLOG_SIZE           (256 * 1024)
+#define FLASHLOG_OFFSET         (FLASHLOG_FLASH_SIZE - FLASHLOG_SIZE)
+#define FLASHLOG_PAGE_BUFFERS   (4)     // Pages waiting to be programmed
+#define FLASHLOG_FLUSH_MS       (5000)
+#define FLASHLOG_CRASH_TRACE    (12)    // Trace events in a crash record
+#define FLASHLOG_REASON_SIZE    (64)
+
+// Persist syslog lines too, not only boot and crash records
+#define FLASHLOG_TEXT
+
+#define FLASHLOG_MAGIC          (0x474f4c50)    // "PLOG"
+
+typedef enum {
+    FLASHLOG_BOOT = 0,      // flashlog_boot_t
+    FLASHLOG_TEXT_LINE,     // Syslog line, not terminated
+    FLASHLOG_CRASH,         // flashlog_crash_t
+    FLASHLOG_END = 0xff     // Rest of the page is unused
+} flashlog_type_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t boot;          // Boot count when the page was written
+    uint32_t reserved;
+} flashlog_page_t;
+
+// Payload follows, padded to 4 bytes
+typedef struct {
+    uint8_t type;
+    uint8_t length;         // Payload bytes
+    uint16_t reserved;
+    uint32_t time;          // us since boot
+} flashlog_entry_t;
+
+typedef struct {
+    uint32_t watchdog_reboot;   // Reset was caused by the watchdog
+    uint32_t scratch[8];        // Watchdog scratch registers
+} flashlog_boot_t;
+
+typedef struct {
+    uint32_t scratch[8];
+    uint32_t pd_flags;
+    uint8_t pd_state;
+    uint8_t pd_polarity;
+    uint8_t pd_vdm_busy;
+    uint8_t trace_count;
+    trace_event_t trace[FLASHLOG_CRASH_TRACE];  // Oldest first
+    char reason[FLASHLOG_REASON_SIZE];
+} flashlog_crash_t;
+
+typedef struct {
+    uint32_t boot;
+    uint32_t pages;         // Programmed since boot
+    uint32_t erases;
+    uint32_t dropped;       // Entries lost with all page buffers full
+} flashlog_stats_t;
+
+void flashlog_init(void);
+void flashlog_poll(bool idle);
+void flashlog_write(flashlog_type_t type, uint32_t time, const void *data,
+        int length);
+void flashlog_crash(const char *reason);
+const flashlog_stats_t *flashlog_get_stats(void);
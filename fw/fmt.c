@@ -0,0 +1,217 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "hardware/divider.h"
+#include "fmt.h"
+
+// Either a va_list or an array of words
+typedef struct {
+    va_list *ap;
+    const uint32_t *args;
+    int argc;
+    int next;
+} fmt_args_t;
+
+static uint32_t fmt_word(fmt_args_t *a) {
+    if (a->ap)
+        return va_arg(*a->ap, unsigned int);
+    return (a->next < a->argc) ? a->args[a->next++] : 0;
+}
+
+static const char *fmt_str(fmt_args_t *a) {
+    if (a->ap)
+        return va_arg(*a->ap, const char *);
+    return (const char *)(uintptr_t)fmt_word(a);
+}
+
+// Digits are written backwards, ending at end. Returns the count.
+static int fmt_dec(char *end, uint32_t v) {
+    char *p = end;
+    do {
+        divmod_result_t r = hw_divider_divmod_u32(v, 10);
+        *--p = '0' + to_remainder_u32(r);
+        v = to_quotient_u32(r);
+    } while (v);
+    return end - p;
+}
+
+static int fmt_hex(char *end, uint32_t v, bool upper) {
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char *p = end;
+    do {
+        *--p = digits[v & 0xf];
+        v >>= 4;
+    } while (v);
+    return end - p;
+}
+
+static void fmt_repeat(fmt_put_t put, void *ctx, char c, int n) {
+    while (n-- > 0)
+        put(ctx, c);
+}
+
+static int fmt_core(fmt_put_t put, void *ctx, const char *format,
+        fmt_args_t *a) {
+    char buf[11];
+    char *end = buf + sizeof(buf);
+    int count = 0;
+    char c;
+
+    while ((c = *format++)) {
+        if (c != '%') {
+            put(ctx, c);
+            count++;
+            continue;
+        }
+
+        bool left = false;
+        char pad = ' ';
+        int width = 0;
+        for (;; format++) {
+            if (*format == '-')
+                left = true;
+            else if (*format == '0')
+                pad = '0';
+            else
+                break;
+        }
+        while ((*format >= '0') && (*format <= '9'))
+            width = width * 10 + (*format++ - '0');
+        while ((*format == 'l') || (*format == 'h') || (*format == 'z'))
+            format++;
+        if (!*format)
+            break;
+
+        const char *s = NULL;
+        char sign = 0;
+        int n;
+        uint32_t v;
+        switch ((c = *format++)) {
+        case 'd':
+        case 'i':
+            v = fmt_word(a);
+            if ((int32_t)v < 0) {
+                sign = '-';
+                v = -v;
+            }
+            n = fmt_dec(end, v);
+            break;
+        case 'u':
+            n = fmt_dec(end, fmt_word(a));
+            break;
+        case 'x':
+        case 'X':
+            n = fmt_hex(end, fmt_word(a), c == 'X');
+            break;
+        case 'p':
+            n = fmt_hex(end, fmt_word(a), false);
+            sign = 'x';
+            break;
+        case 'c':
+            end[-1] = (char)fmt_word(a);
+            n = 1;
+            break;
+        case 's':
+            s = fmt_str(a);
+            if (!s)
+                s = "(null)";
+            n = strlen(s);
+            pad = ' ';
+            break;
+        default:
+            // %% and anything unknown come out as is
+            put(ctx, c);
+            count++;
+            continue;
+        }
+        if (!s)
+            s = end - n;
+
+        int prefix = (sign == 'x') ? 2 : (sign ? 1 : 0);
+        int fill = width - n - prefix;
+        if (fill < 0)
+            fill = 0;
+        if (!left && (pad == ' '))
+            fmt_repeat(put, ctx, ' ', fill);
+        if (sign == 'x') {
+            put(ctx, '0');
+            put(ctx, 'x');
+        }
+        else if (sign) {
+            put(ctx, sign);
+        }
+        if (!left && (pad == '0'))
+            fmt_repeat(put, ctx, '0', fill);
+        for (int i = 0; i < n; i++)
+            put(ctx, s[i]);
+        if (left)
+            fmt_repeat(put, ctx, ' ', fill);
+        count += prefix + fill + n;
+    }
+    return count;
+}
+
+int fmt_vformat(fmt_put_t put, void *ctx, const char *format, va_list ap) {
+    va_list copy;
+    va_copy(copy, ap);
+    fmt_args_t a = {.ap = &copy};
+    int count = fmt_core(put, ctx, format, &a);
+    va_end(copy);
+    return count;
+}
+
+int fmt_format_words(fmt_put_t put, void *ctx, const char *format,
+        const uint32_t *args, int argc) {
+    fmt_args_t a = {.args = args, .argc = argc};
+    return fmt_core(put, ctx, format, &a);
+}
+
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+} fmt_buf_t;
+
+static void fmt_buf_put(void *ctx, char c) {
+    fmt_buf_t *b = ctx;
+    if (b->len + 1 < b->size)
+        b->buf[b->len++] = c;
+}
+
+// Same truncation and termination as vsnprintf
+int fmt_vsnprintf(char *buf, size_t size, const char *format, va_list ap) {
+    fmt_buf_t b = {buf, size, 0};
+    int count = fmt_vformat(fmt_buf_put, &b, format, ap);
+    if (size)
+        buf[b.len] = '\0';
+    return count;
+}
+
+int fmt_snprintf(char *buf, size_t size, const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    int count = fmt_vsnprintf(buf, size, format, ap);
+    va_end(ap);
+    return count;
+}
@@ -0,0 +1,47 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Small printf for the log and the UI. It knows the conversions the
+// firmware uses: %d %i %u %x %X %p %c %s %%, with the '-' and '0' flags and
+// a field width. Length modifiers (l, h, z) are accepted and ignored, every
+// argument is a 32-bit word. Decimal digits come from the SIO divider, one
+// divide per digit for both quotient and remainder.
+//
+// Output goes through put(), one character at a time, so callers can write
+// straight into where the text ends up. All functions return the number of
+// characters produced.
+
+typedef void (*fmt_put_t)(void *ctx, char c);
+
+int fmt_vformat(fmt_put_t put, void *ctx, const char *format, va_list ap);
+// Arguments from an array of words, as stored by syslog_defer(). Missing
+// ones read as 0.
+int fmt_format_words(fmt_put_t put, void *ctx, const char *format,
+        const uint32_t *args, int argc);
+int fmt_vsnprintf(char *buf, size_t size, const char *format, va_list ap);
+int fmt_snprintf(char *buf, size_t size, const char *format, ...)
+        __attribute__((format(gnu_printf, 3, 4)));
@@ -12,6 +12,7 @@
 #include "usb_pd_tcpm.h"
 #include "tcpm.h"
 #include "usb_pd.h"
+#include "trace.h"
 
 #define PACKET_IS_GOOD_CRC(head) (PD_HEADER_TYPE(head) == PD_CTRL_GOOD_CRC && \
 				 PD_HEADER_CNT(head) == 0)
@@ -741,6 +742,8 @@ static int fusb302_tcpm_get_message(int port, uint32_t *payload, int *head)
 	} while (!rv && PACKET_IS_GOOD_CRC(*head) &&
 		 !fusb302_rx_fifo_is_empty(port));
 
+	TRACE(TRACE_TCPC_GET_MSG, *head);
+
 	if (!rv) {
 		/* Discard GoodCRC packets */
 		if (PACKET_IS_GOOD_CRC(*head))
@@ -781,6 +784,8 @@ static int fusb302_tcpm_transmit(int port, enum tcpm_transmit_type type,
 
 	int reg;
 
+	TRACE(TRACE_TCPC_TRANSMIT, type);
+
 	/* Flush the TXFIFO */
 	fusb302_flush_tx_fifo(port);
 
@@ -857,6 +862,7 @@ void fusb302_tcpc_alert(int port)
 	tcpc_read(port, TCPC_REG_INTERRUPT, &interrupt);
 	tcpc_read(port, TCPC_REG_INTERRUPTA, &interrupta);
 	tcpc_read(port, TCPC_REG_INTERRUPTB, &interruptb);
+	TRACE(TRACE_TCPC_ALERT, (interrupta << 8) | (interrupt & 0xff));
 
 	/*
 		* Ignore BC_LVL changes when transmitting / receiving PD,
@@ -23,30 +23,52 @@
 #include "pico/stdlib.h"
 #include "pico/binary_info.h"
 #include "hardware/i2c.h"
+#include "hardware/structs/bus_ctrl.h"
 #include "lcd.h"
+#include "gfx.h"
 #include "ui.h"
+#include "dash.h"
 #include "syslog.h"
+#include "logstream.h"
+#include "flashlog.h"
+#include "wdog.h"
 #include "utils.h"
 #include "tcpm_driver.h"
 #include "usb_pd.h"
 #include "ptn3460.h"
+#include "bench.h"
+#include "memstat.h"
+#include "prof.h"
+#include "trace.h"
 
 uint16_t colors[3] = {0xf800, 0x07e0, 0x001f};
 
+// Push button to ground turning the screen upside down, if wired. Each press
+// toggles lcd_set_orientation().
+//#define ORIENT_BTN_PIN (15)
+#define ORIENT_BTN_DEBOUNCE_MS (30)
+
 bool reserved_addr(uint8_t addr) {
     return (addr & 0x78) == 0 || (addr & 0x78) == 0x78;
 }
 
-void i2c_scan() {
-    ui_printf(0, 0, "I2C Bus Scan");
-    ui_printf(0, 8, "   0123456789ABCDEF");
-    int x = 0, y = 16;
+// Next address to probe, -1 before the headers are drawn
+static int i2c_scan_addr = -1;
 
-    for (int addr = 0; addr < (1 << 7); ++addr) {
-        if (addr % 16 == 0) {
-            ui_printf(x, y, "%02x ", addr);
-            x += 18;
-        }
+// Scan the bus one probe per chunk, call until it returns true. The TCPC is
+// on the same bus, PD gets it back between slices.
+bool i2c_scan(void) {
+    if (i2c_scan_addr < 0) {
+        ui_printf(0, 0, "I2C Bus Scan");
+        ui_printf(0, 8, "   0123456789ABCDEF");
+        i2c_scan_addr = 0;
+    }
+
+    while (i2c_scan_addr < (1 << 7)) {
+        int addr = i2c_scan_addr++;
+        int y = 16 + (addr / 16) * 8;
+        if (addr % 16 == 0)
+            ui_printf(0, y, "%02x ", addr);
 
         // Perform a 1-byte dummy read from the probe address. If a slave
         // acknowledges this address, the function returns the number of bytes
@@ -61,34 +83,162 @@ void i2c_scan() {
         else
             ret = i2c_read_blocking(i2c0, addr, &rxdata, 1, false);
 
-        ui_printf(x, y, ret < 0 ? "." : "@");
-        x += 6;
-        if(addr % 16 == 15) {
-            x = 0; y += 8;
-        }
+        ui_printf(18 + (addr % 16) * 6, y, ret < 0 ? "." : "@");
+        if (ui_slice_done())
+            break;
+    }
+    ui_update();
+    if (i2c_scan_addr < (1 << 7))
+        return false;
+    i2c_scan_addr = -1;
+    return true;
+}
+
+// ui_yield_fn_t, hand the loop back when a PD timer is due
+static bool ui_yield(void) {
+    return pd_work_pending(0);
+}
+
+// Flash writes stall everything for up to 50 ms. Keep them away from PD
+// negotiation, and from LCD transfers that read constants from flash.
+static bool flashlog_idle(void) {
+    int state = pd_get_task_state(0);
+    if (lcd_is_busy() || pd_is_vdm_busy(0))
+        return false;
+    return !pd_is_connected(0) || (state == PD_STATE_SNK_READY) ||
+            (state == PD_STATE_SRC_READY);
+}
+
+extern int dp_enabled;
+static bool hpd_sent;
+
+// Keep the contract and the DP state for a warm restart, see wdog.h
+static void warm_save(void) {
+    struct pd_warm_state s;
+    uint32_t ctx[WDOG_CTX_WORDS];
+
+    if (!pd_get_warm_state(0, &s)) {
+        wdog_set_context(NULL);
+        return;
+    }
+    ctx[0] = s.polarity | (s.data_role << 1) | ((s.rev & 0x3) << 2) |
+            ((s.requested_idx & 0xf) << 4) |
+            ((pd_alt_mode(0, USB_SID_DISPLAYPORT) & 0x7) << 8) |
+            (dp_enabled << 11) | (hpd_sent << 12) |
+            ((pd_dp_pin_config(0) & 0x3f) << 13);
+    ctx[1] = s.supply_voltage | (s.curr_limit << 16);
+    wdog_set_context(ctx);
+}
+
+static bool warm_resume(const uint32_t *ctx) {
+    struct pd_warm_state s = {
+        .polarity = ctx[0] & 0x1,
+        .data_role = (ctx[0] >> 1) & 0x1,
+        .rev = (ctx[0] >> 2) & 0x3,
+        .requested_idx = (ctx[0] >> 4) & 0xf,
+        .supply_voltage = ctx[1] & 0xffff,
+        .curr_limit = ctx[1] >> 16
+    };
+
+    if (!pd_warm_restart(0, &s))
+        return false;
+    pd_restore_alt_mode(0, (ctx[0] >> 8) & 0x7, (ctx[0] >> 11) & 0x1,
+            (ctx[0] >> 13) & 0x3f);
+    // The partner saw HPD go high before the restart
+    hpd_sent = (ctx[0] >> 12) & 0x1;
+    return true;
+}
+
+#ifdef DASH_ENABLE
+static void dash_poll(void) {
+    dash_status_t s = {0};
+    int pins;
+
+    if (!dash_due())
+        return;
+    s.attached = pd_is_connected(0);
+    if (s.attached) {
+        s.contract = pd_get_contract(0, &s.mv, &s.ma);
+        s.source = (pd_get_role(0) == PD_ROLE_SOURCE);
+        s.dfp = (pd_get_data_role(0) == PD_ROLE_DFP);
+        s.polarity = pd_get_polarity(0);
     }
+    pins = pd_dp_pin_config(0);
+    for (int i = 0; i < 6; i++)
+        if (pins & (1 << i))
+            s.dp_pin = 'A' + i;
+    s.hpd = hpd_sent && dp_enabled;
+    s.ptn3460_up = ptn3460_is_up();
+    dash_update(&s);
 }
+#endif
+
+#ifdef ORIENT_BTN_PIN
+static void orient_btn_init(void) {
+    gpio_init(ORIENT_BTN_PIN);
+    gpio_set_dir(ORIENT_BTN_PIN, GPIO_IN);
+    gpio_pull_up(ORIENT_BTN_PIN);
+}
+
+// Act on a level once it has held for the debounce time
+static void orient_btn_poll(void) {
+    static bool raw = true;
+    static bool pressed;
+    static absolute_time_t settle;
+    bool level = gpio_get(ORIENT_BTN_PIN);
+
+    if (level != raw) {
+        raw = level;
+        settle = make_timeout_time_ms(ORIENT_BTN_DEBOUNCE_MS);
+        return;
+    }
+    if ((pressed == !raw) || !time_reached(settle))
+        return;
+    pressed = !raw;
+    if (pressed)
+        lcd_set_orientation((lcd_get_orientation() == LCD_ORIENT_NORMAL) ?
+                LCD_ORIENT_FLIPPED : LCD_ORIENT_NORMAL);
+}
+#endif
 
 int main()
 {
+    memstat_init();
     stdio_init_all();
+    trace_init();
+    logstream_init();
+    flashlog_init();
+    // After flashlog_init(), which records the scratch registers as found
+    wdog_init();
+
+    // PD runs on core 0, let it win arbitration against the LCD DMA
+    bus_ctrl_hw->priority = BUSCTRL_BUS_PRIORITY_PROC0_BITS;
 
     lcd_init();
+    gfx_init();
     ui_init();
     lcd_update();
 
+    bench_run();
+
     int result = tcpm_init(0);
     if (result)
         fatal("Failed to initialize TCPC");
 
     int cc1, cc2;
     tcpc_config[0].drv->get_cc(0, &cc1, &cc2);
-    syslog_printf("CC status %d %d", cc1, cc2);
+    SYSLOG(TCPC, SYSLOG_INFO, "CC status %d %d", cc1, cc2);
 
     ptn3460_init();
     pd_init(0);
+    uint32_t warm_ctx[WDOG_CTX_WORDS];
+    if (wdog_get_context(warm_ctx) && warm_resume(warm_ctx))
+        syslog_printf("Warm restart, missed %02x", wdog_missed());
+    else if (wdog_caused_reset())
+        syslog_printf("Watchdog reset, missed %02x", wdog_missed());
     sleep_ms(50);
 
+    memstat_report();
     syslog_disp();
 
     const uint LED_PIN = 22;
@@ -97,19 +247,63 @@ int main()
     gpio_put(LED_PIN, true);
     int i = 0;
 
-    extern int dp_enabled;
-    bool hpd_sent = false;
+
+#ifdef PROF_ENABLE
+    prof_start(PROF_DEFAULT_RATE);
+    absolute_time_t prof_deadline = make_timeout_time_ms(PROF_DUMP_INTERVAL_MS);
+#endif
+
+#ifdef DASH_ENABLE
+    dash_init();
+#endif
+    ui_set_yield_fn(ui_yield);
+#ifdef ORIENT_BTN_PIN
+    orient_btn_init();
+#endif
+
+    uint32_t lcd_frames = 0;
+    wdog_start();
 
     while (1) {
         // Interrupt is not available, polling
         fusb302_tcpc_alert(0);
+        wdog_checkin(WDOG_TCPC);
         pd_run_state_machine(0);
+        wdog_checkin(WDOG_PD);
         if (dp_enabled && !hpd_sent && !pd_is_vdm_busy(0)) {
-            syslog_printf("DP enabled\n");
+            SYSLOG(POLICY, SYSLOG_INFO, "DP enabled\n");
             pd_send_hpd(0, hpd_high);
             hpd_sent = true;
         }
+        // Screen updates get a bounded share of the loop, see ui.h
+        ui_slice_start(UI_SLICE_US);
+#ifdef DASH_ENABLE
+        // The deferred records still have to reach the log
+        syslog_flush();
+        dash_poll();
+#else
         syslog_disp();
+#endif
+#ifdef ORIENT_BTN_PIN
+        orient_btn_poll();
+#endif
+        lcd_poll();
+        if (lcd_get_stats()->frames != lcd_frames || !lcd_is_busy()) {
+            lcd_frames = lcd_get_stats()->frames;
+            wdog_checkin(WDOG_LCD);
+        }
+        trace_poll();
+        logstream_poll();
+        flashlog_poll(flashlog_idle());
+        warm_save();
+        wdog_feed();
+#ifdef PROF_ENABLE
+        if (PROF_DUMP_INTERVAL_MS && time_reached(prof_deadline)) {
+            prof_dump();
+            prof_reset();
+            prof_deadline = make_timeout_time_ms(PROF_DUMP_INTERVAL_MS);
+        }
+#endif
     }
 
     return 0;
@@ -0,0 +1,257 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <stdint.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/interp.h"
+#include "gfx.h"
+
+#ifdef LCD_LINE_MODE
+void gfx_init(void) {
+}
+
+bool gfx_busy(void) {
+    return false;
+}
+
+void gfx_wait(void) {
+}
+#else
+#define GFX_INTERP interp1
+
+// Control blocks written by gfx_ctrl_dma into the data channel's alias 3
+// registers: {ctrl, write address, count, read address}. A copy that needs
+// a bounce takes two blocks per row, plus the null block ending the chain.
+#define GFX_MAX_BLOCKS (LCD_HEIGHT * 2 + 1)
+
+static int gfx_dma;
+static int gfx_ctrl_dma;
+static bool gfx_running;
+static uint32_t gfx_cb[GFX_MAX_BLOCKS][4];
+static uint32_t gfx_color;
+#ifndef LCD_INDEXED
+// Row bounce buffer for copies overlapping within a row
+static uint32_t gfx_row[LCD_WIDTH / 2];
+#endif
+
+static uint32_t gfx_ctrl(enum dma_channel_transfer_size size, bool read_inc) {
+    dma_channel_config c = dma_channel_get_default_config(gfx_dma);
+    channel_config_set_transfer_data_size(&c, size);
+    channel_config_set_read_increment(&c, read_inc);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_chain_to(&c, gfx_ctrl_dma);
+    channel_config_set_irq_quiet(&c, true);
+    return channel_config_get_ctrl_value(&c);
+}
+
+static void gfx_cb_set(uint32_t *cb, uint32_t ctrl, void *dst, uint32_t count,
+        const void *src) {
+    cb[0] = ctrl;
+    cb[1] = (uint32_t)dst;
+    cb[2] = count;
+    cb[3] = (uint32_t)src;
+}
+
+// Set up the interpolator to step two addresses by a fixed stride each.
+// Every pop returns the next row, starting from dst/src themselves.
+static void gfx_step_init(void *dst, int dst_step, const void *src,
+        int src_step) {
+    interp_config cfg = interp_default_config();
+    interp_config_set_add_raw(&cfg, true);
+    interp_set_config(GFX_INTERP, 0, &cfg);
+    interp_set_config(GFX_INTERP, 1, &cfg);
+    GFX_INTERP->base[0] = dst_step;
+    GFX_INTERP->base[1] = src_step;
+    GFX_INTERP->accum[0] = (uint32_t)dst - dst_step;
+    GFX_INTERP->accum[1] = (uint32_t)src - src_step;
+}
+
+static void gfx_start(int blocks) {
+    gfx_cb_set(gfx_cb[blocks], gfx_ctrl(DMA_SIZE_16, false), NULL, 0, NULL);
+    dma_hw->intr = 1u << gfx_dma;
+    gfx_running = true;
+    dma_channel_set_read_addr(gfx_ctrl_dma, gfx_cb, true);
+}
+
+void gfx_init(void) {
+    gfx_dma = dma_claim_unused_channel(true);
+    gfx_ctrl_dma = dma_claim_unused_channel(true);
+
+    // Same scheme as the LCD DMA, the write ring wraps back to CTRL after
+    // each 4-word block
+    dma_channel_config c = dma_channel_get_default_config(gfx_ctrl_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, 4);
+    dma_channel_configure(gfx_ctrl_dma, &c,
+            &dma_hw->ch[gfx_dma].al3_ctrl, gfx_cb, 4, false);
+    gfx_running = false;
+}
+
+// The chain ends with a null trigger, which with IRQ_QUIET raises the
+// channel's raw interrupt flag. Nothing enables the IRQ, it is only polled.
+bool gfx_busy(void) {
+    if (gfx_running && (dma_hw->intr & (1u << gfx_dma)))
+        gfx_running = false;
+    return gfx_running;
+}
+
+void gfx_wait(void) {
+    while (gfx_busy());
+}
+
+#ifdef LCD_INDEXED
+static inline uint8_t gfx_get(uint32_t offset) {
+    uint8_t v = framebuffer[offset >> 1];
+    return (offset & 1) ? (v >> 4) : (v & 0x0f);
+}
+
+// Two pixels per byte. Pixels not pairing up within a byte at the row ends
+// are put by the CPU, the DMA fills the whole bytes in between.
+void gfx_fill(const lcd_rect_t *rect, uint16_t c) {
+    uint32_t height = rect->y2 - rect->y1 + 1;
+    uint32_t b1 = (rect->x1 + 1) / 2;
+    uint32_t b2 = (rect->x2 + 1) / 2;
+    uint32_t count = b2 - b1;
+    uint32_t ctrl = gfx_ctrl(DMA_SIZE_8, false);
+    uint8_t v = lcd_color_index(c);
+    int blocks = 0;
+
+    gfx_wait();
+    for (int y = rect->y1; y <= rect->y2; y++) {
+        if (rect->x1 & 1)
+            lcd_fb_put(y * LCD_WIDTH + rect->x1, v);
+        if (!(rect->x2 & 1))
+            lcd_fb_put(y * LCD_WIDTH + rect->x2, v);
+    }
+    if ((int)count <= 0)
+        return;
+
+    uint8_t *dst = &framebuffer[rect->y1 * LCD_WIDTH / 2 + b1];
+    gfx_color = v * 0x11111111u;
+    if (count == LCD_WIDTH / 2) {
+        gfx_cb_set(gfx_cb[blocks++], ctrl, dst, count * height, &gfx_color);
+    }
+    else {
+        gfx_step_init(dst, LCD_WIDTH / 2, NULL, 0);
+        for (uint32_t y = 0; y < height; y++)
+            gfx_cb_set(gfx_cb[blocks++], ctrl,
+                    (void *)interp_pop_lane_result(GFX_INTERP, 0),
+                    count, &gfx_color);
+    }
+    gfx_start(blocks);
+}
+
+// Nibble shifts rule out the DMA for most copies, this one runs on the CPU
+// and is done when it returns. Overlaps are handled as in the RGB565 case.
+void gfx_copy(const lcd_rect_t *src, int x, int y) {
+    int width = src->x2 - src->x1 + 1;
+    int height = src->y2 - src->y1 + 1;
+    int dx = x - src->x1;
+    int dy = y - src->y1;
+
+    if ((dx == 0) && (dy == 0))
+        return;
+    gfx_wait();
+    for (int i = 0; i < height; i++) {
+        int row = (dy > 0) ? (height - 1 - i) : i;
+        uint32_t s = (src->y1 + row) * LCD_WIDTH + src->x1;
+        uint32_t d = (y + row) * LCD_WIDTH + x;
+        if ((dy == 0) && (dx > 0)) {
+            for (int k = width - 1; k >= 0; k--)
+                lcd_fb_put(d + k, gfx_get(s + k));
+        }
+        else if (!((s ^ d) & 1) && !(width & 1) && !(s & 1)) {
+            memmove(&framebuffer[d / 2], &framebuffer[s / 2], width / 2);
+        }
+        else {
+            for (int k = 0; k < width; k++)
+                lcd_fb_put(d + k, gfx_get(s + k));
+        }
+    }
+}
+#else
+void gfx_fill(const lcd_rect_t *rect, uint16_t c) {
+    uint32_t width = rect->x2 - rect->x1 + 1;
+    uint32_t height = rect->y2 - rect->y1 + 1;
+    // Rows all share the alignment of the first one as LCD_WIDTH is even
+    bool size32 = !(rect->x1 & 1) && !(width & 1);
+    uint32_t ctrl = gfx_ctrl(size32 ? DMA_SIZE_32 : DMA_SIZE_16, false);
+    int blocks = 0;
+
+    gfx_wait();
+    uint16_t *dst = &framebuffer[rect->y1 * LCD_WIDTH + rect->x1];
+    gfx_color = c | ((uint32_t)c << 16);
+    if (width == LCD_WIDTH) {
+        uint32_t count = width * height;
+        gfx_cb_set(gfx_cb[blocks++], ctrl, dst, size32 ? count / 2 : count,
+                &gfx_color);
+    }
+    else {
+        gfx_step_init(dst, LCD_WIDTH * 2, NULL, 0);
+        for (uint32_t y = 0; y < height; y++)
+            gfx_cb_set(gfx_cb[blocks++], ctrl,
+                    (void *)interp_pop_lane_result(GFX_INTERP, 0),
+                    size32 ? width / 2 : width, &gfx_color);
+    }
+    gfx_start(blocks);
+}
+
+// Move the src rectangle so its top left corner lands on (x, y). Overlaps
+// are handled: rows go bottom up when moving down, and rows overlapping
+// themselves going right are bounced through a row buffer as the DMA can
+// only copy forwards.
+void gfx_copy(const lcd_rect_t *src, int x, int y) {
+    uint32_t width = src->x2 - src->x1 + 1;
+    uint32_t height = src->y2 - src->y1 + 1;
+    int dx = x - src->x1;
+    int dy = y - src->y1;
+    bool size32 = !(src->x1 & 1) && !(x & 1) && !(width & 1);
+    bool bounce = (dy == 0) && (dx > 0) && ((uint32_t)dx < width);
+    uint32_t ctrl = gfx_ctrl(size32 ? DMA_SIZE_32 : DMA_SIZE_16, true);
+    uint32_t count = size32 ? width / 2 : width;
+    int first = (dy > 0) ? (height - 1) : 0;
+    int step = (dy > 0) ? -LCD_WIDTH * 2 : LCD_WIDTH * 2;
+    int blocks = 0;
+
+    if ((dx == 0) && (dy == 0))
+        return;
+    gfx_wait();
+    gfx_step_init(&framebuffer[(y + first) * LCD_WIDTH + x], step,
+            &framebuffer[(src->y1 + first) * LCD_WIDTH + src->x1], step);
+    for (uint32_t i = 0; i < height; i++) {
+        void *s = (void *)interp_peek_lane_result(GFX_INTERP, 1);
+        void *d = (void *)interp_pop_lane_result(GFX_INTERP, 0);
+        if (bounce) {
+            gfx_cb_set(gfx_cb[blocks++], ctrl, gfx_row, count, s);
+            gfx_cb_set(gfx_cb[blocks++], ctrl, d, count, gfx_row);
+        }
+        else {
+            gfx_cb_set(gfx_cb[blocks++], ctrl, d, count, s);
+        }
+    }
+    gfx_start(blocks);
+}
+#endif
+#endif
@@ -0,0 +1,43 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lcd.h"
+
+// 2D primitives on the LCD back buffer, done by DMA in the background. All
+// coordinates are LCD coordinates, inclusive, and must be within the screen.
+// Only one operation runs at a time, starting another waits for the previous
+// one. Call gfx_wait() before touching framebuffer from the CPU.
+// Uses interpolator 1 on core 0 for row address stepping.
+
+// With LCD_LINE_MODE there is no framebuffer to draw into, only the
+// init/busy/wait calls remain and do nothing.
+
+void gfx_init(void);
+#ifndef LCD_LINE_MODE
+void gfx_fill(const lcd_rect_t *rect, uint16_t c);
+void gfx_copy(const lcd_rect_t *src, int x, int y);
+#endif
+bool gfx_busy(void);
+void gfx_wait(void);
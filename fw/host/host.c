@@ -0,0 +1,61 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <stdint.h>
+#include "pico/stdlib.h"
+#include "logstream.h"
+#include "flashlog.h"
+
+// SDK and firmware pieces the UI sources call into, for the host build
+
+static uint64_t host_time_us;
+static host_timer_hw_t host_timer;
+host_timer_hw_t *timer_hw = &host_timer;
+
+void host_set_time_us(uint64_t us) {
+    host_time_us = us;
+    host_timer.timerawl = (uint32_t)us;
+}
+
+uint32_t time_us_32(void) {
+    return (uint32_t)host_time_us;
+}
+
+absolute_time_t get_absolute_time(void) {
+    return host_time_us;
+}
+
+void logstream_write(const char *text, int length) {
+    (void)text;
+    (void)length;
+}
+
+void flashlog_crash(const char *msg) {
+    (void)msg;
+}
+
+void flashlog_write(flashlog_type_t type, uint32_t time, const void *data,
+        int length) {
+    (void)type;
+    (void)time;
+    (void)data;
+    (void)length;
+}
@@ -0,0 +1,324 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "lcd.h"
+#include "gfx.h"
+#include "lcd_host.h"
+
+#ifdef LCD_INDEXED
+#error "The host emulator has the RGB565 and line modes only"
+#endif
+
+// Column/row address and memory write commands with their parameters
+#define LCD_HOST_WINDOW_BYTES (11)
+#define LCD_HOST_QUEUE_SIZE (LCD_MAX_WINDOWS * 2)
+
+typedef struct {
+    bool x_axis;
+    int top;
+    int height;
+    int offset;
+} lcd_scroll_t;
+
+#ifdef LCD_LINE_MODE
+static lcd_line_fn_t lcd_line_fn;
+#else
+// Double buffered like lcd.c, the front buffer is what goes out
+static uint16_t lcd_buffers[2][LCD_WIDTH * LCD_HEIGHT];
+uint16_t *framebuffer = lcd_buffers[0];
+static uint16_t *lcd_front = lcd_buffers[1];
+#endif
+
+// What the panel controller holds
+static uint16_t lcd_gram[LCD_WIDTH * LCD_HEIGHT];
+static lcd_scroll_t lcd_scroll;
+static lcd_scroll_t lcd_scroll_next;
+static lcd_orient_t lcd_orient;
+static lcd_orient_t lcd_orient_next;
+static lcd_rect_t lcd_queue[LCD_HOST_QUEUE_SIZE];
+static int lcd_queue_count;
+static bool lcd_held;
+static bool lcd_in_flight;
+static lcd_stats_t lcd_stats = {.spi_freq = 62500000};
+static lcd_host_stats_t lcd_host_stats;
+
+// Same split as lcd.c, the panel only scrolls along its rows
+static bool lcd_scroll_hw(const lcd_scroll_t *s) {
+#ifdef LCD_VERTICAL
+    return s->height && !s->x_axis;
+#else
+    (void)s;
+    return false;
+#endif
+}
+
+static lcd_rect_t lcd_scroll_rect(const lcd_scroll_t *s) {
+    lcd_rect_t r = {0, 0, LCD_WIDTH - 1, LCD_HEIGHT - 1};
+    if (s->x_axis) {
+        r.x1 = s->top;
+        r.x2 = s->top + s->height - 1;
+    }
+    else {
+        r.y1 = s->top;
+        r.y2 = s->top + s->height - 1;
+    }
+    return r;
+}
+
+static int lcd_scroll_map(int n) {
+    const lcd_scroll_t *s = &lcd_scroll;
+    if ((n < s->top) || (n >= s->top + s->height))
+        return n;
+    return s->top + (n - s->top + s->offset) % s->height;
+}
+
+// Framebuffer row y as it goes out, software scrolling applied
+static void lcd_source_line(int y, uint16_t *buf) {
+    uint16_t line[LCD_WIDTH];
+    bool soft = lcd_scroll.height && !lcd_scroll_hw(&lcd_scroll);
+
+    if (soft && !lcd_scroll.x_axis)
+        y = lcd_scroll_map(y);
+#ifdef LCD_LINE_MODE
+    if (lcd_line_fn)
+        lcd_line_fn(y, line);
+    else
+        memset(line, 0, sizeof(line));
+#else
+    memcpy(line, &lcd_front[y * LCD_WIDTH], sizeof(line));
+#endif
+    for (int x = 0; x < LCD_WIDTH; x++)
+        buf[x] = (soft && lcd_scroll.x_axis) ? line[lcd_scroll_map(x)] :
+                line[x];
+}
+
+static void lcd_send_rect(const lcd_rect_t *r) {
+    uint16_t line[LCD_WIDTH];
+    for (int y = r->y1; y <= r->y2; y++) {
+        lcd_source_line(y, line);
+        memcpy(&lcd_gram[y * LCD_WIDTH + r->x1], &line[r->x1],
+                (r->x2 - r->x1 + 1) * 2);
+    }
+    lcd_host_stats.windows++;
+    lcd_host_stats.bytes += LCD_HOST_WINDOW_BYTES +
+            (r->x2 - r->x1 + 1) * (r->y2 - r->y1 + 1) * 2;
+}
+
+static void lcd_queue_rect(const lcd_rect_t *r) {
+    if (lcd_queue_count == LCD_HOST_QUEUE_SIZE) {
+        // Out of room, send it all
+        lcd_queue[0] = (lcd_rect_t){0, 0, LCD_WIDTH - 1, LCD_HEIGHT - 1};
+        lcd_queue_count = 1;
+        return;
+    }
+    lcd_queue[lcd_queue_count++] = *r;
+}
+
+void lcd_init(void) {
+    memset(lcd_gram, 0, sizeof(lcd_gram));
+    memset(&lcd_scroll, 0, sizeof(lcd_scroll));
+    lcd_scroll_next = lcd_scroll;
+    lcd_orient = lcd_orient_next;
+    lcd_queue_count = 0;
+    lcd_held = false;
+    lcd_in_flight = false;
+}
+
+#ifdef LCD_LINE_MODE
+void lcd_set_line_fn(lcd_line_fn_t fn) {
+    lcd_line_fn = fn;
+}
+#endif
+
+void lcd_set_window(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2) {
+    (void)x1;
+    (void)y1;
+    (void)x2;
+    (void)y2;
+}
+
+#ifndef LCD_LINE_MODE
+static void lcd_sync_back(void) {
+    for (int i = 0; i < lcd_queue_count; i++) {
+        const lcd_rect_t *r = &lcd_queue[i];
+        for (int y = r->y1; y <= r->y2; y++)
+            memcpy(&framebuffer[y * LCD_WIDTH + r->x1],
+                    &lcd_front[y * LCD_WIDTH + r->x1],
+                    (r->x2 - r->x1 + 1) * 2);
+    }
+}
+#endif
+
+// Buffers are swapped and the windows copied back as in lcd.c, then the
+// transfer finishes right away. A frame is only ever in flight when a test
+// asks for one with lcd_host_set_in_flight().
+void lcd_poll(void) {
+    const lcd_scroll_t *n = &lcd_scroll_next;
+    bool scrolled = (n->x_axis != lcd_scroll.x_axis) ||
+            (n->top != lcd_scroll.top) || (n->height != lcd_scroll.height) ||
+            (n->offset != lcd_scroll.offset);
+    bool flipped = (lcd_orient_next != lcd_orient);
+    if (lcd_in_flight || lcd_held || (!lcd_queue_count && !scrolled &&
+            !flipped))
+        return;
+#ifndef LCD_LINE_MODE
+    uint16_t *back = lcd_front;
+    lcd_front = framebuffer;
+    framebuffer = back;
+#endif
+    if (flipped)
+        lcd_host_stats.bytes += 2;  // MADCTL
+    if ((scrolled || flipped) && (lcd_scroll_hw(n) ||
+            lcd_scroll_hw(&lcd_scroll)))
+        lcd_host_stats.bytes += 7;  // Scroll area and start address
+    lcd_scroll = *n;
+    lcd_orient = lcd_orient_next;
+    for (int i = 0; i < lcd_queue_count; i++)
+        lcd_send_rect(&lcd_queue[i]);
+#ifndef LCD_LINE_MODE
+    lcd_sync_back();
+#endif
+    lcd_queue_count = 0;
+    lcd_host_stats.updates++;
+    lcd_stats.frames++;
+}
+
+void lcd_update_rects(const lcd_rect_t *rects, int count) {
+    for (int i = 0; i < count; i++)
+        lcd_queue_rect(&rects[i]);
+    lcd_poll();
+}
+
+void lcd_update(void) {
+    lcd_rect_t full = {0, 0, LCD_WIDTH - 1, LCD_HEIGHT - 1};
+    lcd_update_rects(&full, 1);
+}
+
+void lcd_set_scroll(bool x_axis, int top, int height, int offset) {
+    lcd_scroll_t *s = &lcd_scroll_next;
+    if (height)
+        offset = ((offset % height) + height) % height;
+    else
+        offset = 0;
+    if ((s->x_axis == x_axis) && (s->top == top) && (s->height == height) &&
+            (s->offset == offset))
+        return;
+    bool was_hw = lcd_scroll_hw(s);
+    if (s->height && !was_hw && ((s->x_axis != x_axis) ||
+            (s->top != top) || (s->height != height))) {
+        lcd_rect_t area = lcd_scroll_rect(s);
+        lcd_queue_rect(&area);
+    }
+    s->x_axis = x_axis;
+    s->top = top;
+    s->height = height;
+    s->offset = offset;
+    if (!lcd_scroll_hw(s) && height) {
+        lcd_rect_t area = lcd_scroll_rect(s);
+        lcd_queue_rect(&area);
+    }
+}
+
+// The model keeps the GRAM in address order, flipping only changes how
+// lcd_host_snapshot() reads it. Everything is sent again, as on the panel.
+void lcd_set_orientation(lcd_orient_t orient) {
+    if ((orient >= LCD_ORIENT_COUNT) || (orient == lcd_orient_next))
+        return;
+    lcd_orient_next = orient;
+    lcd_rect_t full = {0, 0, LCD_WIDTH - 1, LCD_HEIGHT - 1};
+    lcd_queue_rect(&full);
+}
+
+lcd_orient_t lcd_get_orientation(void) {
+    return lcd_orient_next;
+}
+
+void lcd_hold(bool hold) {
+    lcd_held = hold;
+}
+
+bool lcd_is_busy(void) {
+    return lcd_in_flight || (lcd_queue_count != 0);
+}
+
+void lcd_host_set_in_flight(bool busy) {
+    lcd_in_flight = busy;
+}
+
+const lcd_stats_t *lcd_get_stats(void) {
+    return &lcd_stats;
+}
+
+void lcd_host_reset_stats(void) {
+    memset(&lcd_host_stats, 0, sizeof(lcd_host_stats));
+}
+
+const lcd_host_stats_t *lcd_host_get_stats(void) {
+    return &lcd_host_stats;
+}
+
+void lcd_host_snapshot(uint16_t *out) {
+    bool flipped = (lcd_orient == LCD_ORIENT_FLIPPED);
+    for (int y = 0; y < LCD_HEIGHT; y++) {
+        int src = lcd_scroll_hw(&lcd_scroll) ?
+                lcd_scroll_map(y) : y;
+        const uint16_t *line = &lcd_gram[src * LCD_WIDTH];
+        uint16_t *dst = flipped ? &out[(LCD_HEIGHT - 1 - y) * LCD_WIDTH] :
+                &out[y * LCD_WIDTH];
+        for (int x = 0; x < LCD_WIDTH; x++)
+            dst[flipped ? (LCD_WIDTH - 1 - x) : x] = line[x];
+    }
+}
+
+// gfx.h on the CPU, done by the time the call returns
+
+void gfx_init(void) {
+}
+
+#ifndef LCD_LINE_MODE
+void gfx_fill(const lcd_rect_t *rect, uint16_t c) {
+    for (int y = rect->y1; y <= rect->y2; y++)
+        for (int x = rect->x1; x <= rect->x2; x++)
+            framebuffer[y * LCD_WIDTH + x] = c;
+}
+
+void gfx_copy(const lcd_rect_t *src, int x, int y) {
+    int w = src->x2 - src->x1 + 1;
+    int h = src->y2 - src->y1 + 1;
+    // Rows in the order that does not overwrite what is still to be read
+    bool up = (y <= src->y1);
+    for (int i = 0; i < h; i++) {
+        int row = up ? i : (h - 1 - i);
+        memmove(&framebuffer[(y + row) * LCD_WIDTH + x],
+                &framebuffer[(src->y1 + row) * LCD_WIDTH + src->x1], w * 2);
+    }
+}
+#endif
+
+bool gfx_busy(void) {
+    return false;
+}
+
+void gfx_wait(void) {
+}
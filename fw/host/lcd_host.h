@@ -0,0 +1,49 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#pragma once
+
+#include <stdint.h>
+#include "lcd.h"
+
+// Host stand-in for lcd.c and gfx.c. Drawing goes into the back buffer (or
+// through the line callback in LCD_LINE_MODE). lcd_poll() swaps the buffers
+// and copies the windows back the way lcd.c does, and copies them into a
+// model of the panel memory right away, the way the SPI transfer would. Scrolling is applied the way
+// the driver does it: by the panel for vertical scrolls on a vertical
+// panel, by re-sending the whole area otherwise. The panel model only
+// changes through updates, so a missing dirty window shows up as stale
+// pixels in the output.
+
+typedef struct {
+    uint32_t updates;       // lcd_poll() calls that sent something
+    uint32_t windows;
+    uint32_t bytes;         // On the SPI bus, commands included
+} lcd_host_stats_t;
+
+// Keep a frame on the bus: lcd_poll() leaves the queue alone until this is
+// cleared, the way it waits for the DMA on the target
+void lcd_host_set_in_flight(bool busy);
+void lcd_host_reset_stats(void);
+const lcd_host_stats_t *lcd_host_get_stats(void);
+// LCD_WIDTH x LCD_HEIGHT pixels as the panel shows them, upside down when
+// it is flipped
+void lcd_host_snapshot(uint16_t *out);
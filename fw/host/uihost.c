@@ -0,0 +1,363 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "pico/stdlib.h"
+#include "lcd.h"
+#include "ui.h"
+#include "syslog.h"
+#include "dash.h"
+#include "utils.h"
+#include "lcd_host.h"
+
+// Host build of the UI stack. "render <dir>" draws a set of screens and
+// writes each one to <dir>/<name>.ppm the way the panel would show it, in
+// UI orientation, with the LCD traffic each took. "check <dir>" draws the
+// same screens and compares them byte for byte with the images in <dir>,
+// the goldens in golden/<variant>, reporting the first pixel that differs.
+// "bench" times the drawing primitives. Host timings only say whether a
+// change made rendering faster or slower, the on-target numbers come from
+// BENCH_TEXT and BENCH_GFX.
+
+#define UIHOST_BENCH_ROUNDS (2000)
+#define UIHOST_PPM_HEADER_MAX (32)
+#define UIHOST_PPM_MAX (UIHOST_PPM_HEADER_MAX + UI_WIDTH * UI_HEIGHT * 3)
+
+static const char *uihost_dir;
+static bool uihost_check;
+
+// Compare an image with the golden of the same name
+static bool uihost_compare(const char *path, const uint8_t *ppm,
+        size_t len, size_t header) {
+    static uint8_t golden[UIHOST_PPM_MAX + 1];
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    size_t golden_len = fread(golden, 1, sizeof(golden), f);
+    fclose(f);
+
+    if ((golden_len < header) || memcmp(golden, ppm, header)) {
+        printf("%s: not a %dx%d image\n", path, UI_WIDTH, UI_HEIGHT);
+        return false;
+    }
+    for (size_t i = header; i < len; i++) {
+        if ((i < golden_len) && (golden[i] == ppm[i]))
+            continue;
+        size_t px = (i - header) / 3;
+        const uint8_t *got = &ppm[header + px * 3];
+        printf("%s: pixel %zu,%zu is %02x%02x%02x", path, px % UI_WIDTH,
+                px / UI_WIDTH, got[0], got[1], got[2]);
+        if (header + px * 3 + 3 <= golden_len) {
+            const uint8_t *want = &golden[header + px * 3];
+            printf(", expected %02x%02x%02x", want[0], want[1], want[2]);
+        }
+        printf("\n");
+        return false;
+    }
+    if (golden_len != len) {
+        printf("%s: %zu bytes, expected %zu\n", path, golden_len, len);
+        return false;
+    }
+    return true;
+}
+
+// Snapshot the panel as a PPM, then write it out or check it
+static bool uihost_write_ppm(const char *name) {
+    static uint16_t panel[LCD_WIDTH * LCD_HEIGHT];
+    static uint8_t ppm[UIHOST_PPM_MAX];
+    char path[256];
+
+    lcd_host_snapshot(panel);
+    size_t header = snprintf((char *)ppm, UIHOST_PPM_HEADER_MAX,
+            "P6\n%d %d\n255\n", UI_WIDTH, UI_HEIGHT);
+    uint8_t *p = &ppm[header];
+    for (int y = 0; y < UI_HEIGHT; y++) {
+        for (int x = 0; x < UI_WIDTH; x++) {
+#ifdef ROTATE_UI
+            uint16_t c = panel[x * LCD_WIDTH + (LCD_WIDTH - 1 - y)];
+#else
+            uint16_t c = panel[y * LCD_WIDTH + x];
+#endif
+            *p++ = ((c >> 11) & 0x1f) * 255 / 31;
+            *p++ = ((c >> 5) & 0x3f) * 255 / 63;
+            *p++ = (c & 0x1f) * 255 / 31;
+        }
+    }
+    size_t len = p - ppm;
+
+    snprintf(path, sizeof(path), "%s/%s.ppm", uihost_dir, name);
+    bool ok;
+    if (uihost_check) {
+        ok = uihost_compare(path, ppm, len, header);
+    }
+    else {
+        FILE *f = fopen(path, "wb");
+        if (!f) {
+            perror(path);
+            return false;
+        }
+        ok = (fwrite(ppm, 1, len, f) == len);
+        fclose(f);
+    }
+
+    const lcd_host_stats_t *stats = lcd_host_get_stats();
+    printf("%-16s %4u windows %7u bytes%s\n", name, stats->windows,
+            stats->bytes, ok ? "" : "  FAILED");
+    lcd_host_reset_stats();
+    return ok;
+}
+
+// Run the log screen until it has caught up with the log
+static void uihost_syslog_settle(void) {
+    for (int i = 0; i < 256; i++)
+        syslog_disp();
+}
+
+// ui_yield_fn_t, as if PD always had a timer due
+static bool uihost_yield(void) {
+    return true;
+}
+
+// A new log, redrawn from scratch a slot per slice while the update before
+// it is still waiting behind a frame on the bus. The waiting frame must not
+// go out before the redraw is done: the panel would show a half drawn band,
+// and slots drawn before the swap could stay behind in the old buffer.
+static void uihost_syslog_cut_start(void) {
+    lcd_host_set_in_flight(true);
+    syslog_printf("Queued behind the frame on the bus");
+    syslog_disp();
+
+    syslog_init();
+    for (int i = 0; i < 16; i++)
+        syslog_printf("SEND %04x/%d ", 0x21b1 + i, i % 4);
+    ui_set_yield_fn(uihost_yield);
+    ui_slice_start(UI_SLICE_US);
+    syslog_disp();
+    lcd_host_set_in_flight(false);
+    lcd_poll();
+}
+
+static void uihost_syslog_cut_finish(void) {
+    for (int i = 0; i < 256; i++) {
+        ui_slice_start(UI_SLICE_US);
+        syslog_disp();
+        lcd_poll();
+    }
+    ui_set_yield_fn(NULL);
+    ui_slice_start(0);
+}
+
+static const dash_status_t uihost_dash_status = {
+    .attached = true,
+    .contract = true,
+    .mv = 20000,
+    .ma = 3250,
+    .source = false,
+    .dfp = false,
+    .polarity = 1,
+    .dp_pin = 'C',
+    .hpd = true,
+    .ptn3460_up = true
+};
+
+static int uihost_render(void) {
+    bool ok = true;
+
+    lcd_init();
+    lcd_host_reset_stats();
+    ui_init();
+    lcd_update();
+    ok &= uihost_write_ppm("hello");
+
+    // Boot log, with a line long enough to wrap twice
+    host_set_time_us(1234000);
+    syslog_init();
+    syslog_printf("PTN3460 up after %d ms", 12);
+    syslog_printf("CC status %d %d", 2, 0);
+    syslog_printf("The quick brown fox jumps over the lazy dog, "
+            "then over the sleeping cat and into the river");
+    // No glyph past 0x7f, drawn blank
+    syslog_printf("Die at 41\xb0" "C");
+    for (int i = 0; i < 12; i++)
+        syslog_printf("RECV %04x/%d ", 0x11a1 + i, i % 3);
+    uihost_syslog_settle();
+    ok &= uihost_write_ppm("syslog");
+
+    syslog_printf("Watchdog reset, missed %02x", 4);
+    uihost_syslog_settle();
+    ok &= uihost_write_ppm("syslog_new_line");
+
+    syslog_scroll(76);
+    uihost_syslog_settle();
+    ok &= uihost_write_ppm("syslog_scrolled");
+
+    // Still the scrolled log until the new one is complete
+    uihost_syslog_cut_start();
+    ok &= uihost_write_ppm("syslog_cut_held");
+    uihost_syslog_cut_finish();
+    ok &= uihost_write_ppm("syslog_cut");
+
+    // A fatal error while a cut short redraw holds the LCD. The blue screen
+    // has to go out regardless, a hang here is a test timeout.
+    uihost_syslog_cut_start();
+    fatal_report("TCPC I2C error");
+    lcd_poll();
+    ui_set_yield_fn(NULL);
+    ui_slice_start(0);
+    ok &= uihost_write_ppm("fatal_held");
+
+    host_set_time_us(3723400000ull);
+    dash_init();
+    dash_update(&uihost_dash_status);
+    ok &= uihost_write_ppm("dash");
+
+    // A tenth of a second later, only the uptime moves
+    host_set_time_us(3723500000ull);
+    dash_update(&uihost_dash_status);
+    ok &= uihost_write_ppm("dash_tick");
+
+    // Upside down, the same frame sent again with MADCTL in front
+    lcd_set_orientation(LCD_ORIENT_FLIPPED);
+    lcd_poll();
+    ok &= uihost_write_ppm("dash_flipped");
+    lcd_set_orientation(LCD_ORIENT_NORMAL);
+    lcd_poll();
+    lcd_host_reset_stats();
+
+    dash_status_t detached = {.ptn3460_up = true};
+    dash_update(&detached);
+    ok &= uihost_write_ppm("dash_detached");
+
+    return ok ? 0 : 1;
+}
+
+static uint64_t uihost_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t uihost_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+typedef struct {
+    uint64_t ns;
+    uint64_t ticks;
+} uihost_mark_t;
+
+static uihost_mark_t uihost_mark(void) {
+    return (uihost_mark_t){uihost_ns(), uihost_ticks()};
+}
+
+// Time and TSC ticks per item since start
+static void uihost_report(const char *name, uihost_mark_t start, int items) {
+    uihost_mark_t end = uihost_mark();
+    printf("%-16s %10.1f ns %10.1f ticks\n", name,
+            (double)(end.ns - start.ns) / items,
+            (double)(end.ticks - start.ticks) / items);
+}
+
+static int uihost_bench(void) {
+    char line[UI_WIDTH / 6 + 1];
+    int cols = UI_WIDTH / 6;
+    int rows = UI_HEIGHT / 8;
+    uihost_mark_t start;
+
+    for (int i = 0; i < cols; i++)
+        line[i] = '!' + (i * 7) % 90;
+    line[cols] = '\0';
+
+    lcd_init();
+    ui_init();
+    printf("%-16s %13s %16s\n", "per", "time", "TSC");
+
+    start = uihost_mark();
+    for (int r = 0; r < UIHOST_BENCH_ROUNDS; r++)
+        for (int y = 0; y < rows; y++)
+            ui_disp_string(0, y * 8, line, 0xffff);
+    uihost_report("glyph", start, UIHOST_BENCH_ROUNDS * rows * cols);
+
+    start = uihost_mark();
+    for (int r = 0; r < UIHOST_BENCH_ROUNDS; r++) {
+        ui_clear(r & 1 ? 0x0000 : 0x001f);
+        ui_update();
+    }
+    uihost_report("clear", start, UIHOST_BENCH_ROUNDS);
+
+    start = uihost_mark();
+    for (int r = 0; r < UIHOST_BENCH_ROUNDS; r++) {
+        ui_clear(0x0000);
+        for (int y = 0; y < rows; y++)
+            ui_disp_string(0, y * 8, line, 0xffff);
+        ui_update();
+    }
+    uihost_report("full redraw", start, UIHOST_BENCH_ROUNDS);
+
+    // One new line in the log per frame, scrolling the band
+    syslog_init();
+    uihost_syslog_settle();
+    start = uihost_mark();
+    for (int r = 0; r < UIHOST_BENCH_ROUNDS; r++) {
+        syslog_printf("RECV %04x/%d ", r & 0xffff, r % 3);
+        syslog_disp();
+    }
+    uihost_report("log line", start, UIHOST_BENCH_ROUNDS);
+
+    dash_status_t s = uihost_dash_status;
+    dash_init();
+    start = uihost_mark();
+    for (int r = 0; r < UIHOST_BENCH_ROUNDS; r++) {
+        host_set_time_us(r * 100000ull);
+        dash_update(&s);
+    }
+    uihost_report("dash tick", start, UIHOST_BENCH_ROUNDS);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if ((argc == 3) && (!strcmp(argv[1], "render") ||
+            !strcmp(argv[1], "check"))) {
+        uihost_dir = argv[2];
+        uihost_check = !strcmp(argv[1], "check");
+        return uihost_render();
+    }
+    if ((argc == 2) && !strcmp(argv[1], "bench"))
+        return uihost_bench();
+    fprintf(stderr, "usage: %s render <dir> | check <dir> | bench\n",
+            argv[0]);
+    return 2;
+}
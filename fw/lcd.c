@@ -20,28 +20,213 @@
 // SOFTWARE.
 //
 #include <stdint.h>
+#include <string.h>
+#include <limits.h>
 #include "pico/stdlib.h"
-#include "hardware/spi.h"
+#include "hardware/pio.h"
 #include "hardware/dma.h"
 #include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
 #include "lcd.h"
+#include "gfx.h"
+#include "lcd.pio.h"
+#include "trace.h"
 
 // Hardware Connection
-#define LCD_SPI  spi1
-#define LCD_SPI_DREQ DREQ_SPI1_TX
+#define LCD_PIO  pio0
+#define LCD_PIO_IRQ PIO0_IRQ_0
 #define LCD_BL	 6
 #define LCD_RST  7
 #define LCD_RS   8
 #define LCD_CS   9
-#define LCD_SCK  10
+#define LCD_SCK  10 // Must be LCD_CS + 1, both are side-set pins
 #define LCD_MOSI 11
-#define LCD_SPI_FREQ (20*1000*1000)
+#define LCD_SPI_FREQ (62500*1000)
+#define LCD_SPI_FREQ_MIN (15*1000*1000) // Datasheet write cycle limit
+// Step the serial clock down from LCD_SPI_FREQ at boot until register writes
+// read back correctly
+#define LCD_SPI_PROBE
+#define LCD_SPI_PROBE_ROUNDS (16)
+// Tearing effect output of the panel, if wired. Without it buffer swaps are
+// paced by a frame timer derived from the FRMCTR1 settings below.
+//#define LCD_TE_PIN (14)
 
-uint16_t framebuffer[LCD_WIDTH * LCD_HEIGHT];
+// Frame rate = fosc / ((RTNA x 2 + 40) x (LINE + FPA + BPA + 2))
+#define LCD_FOSC (850000)
+#define LCD_RTNA (0x05)
+#define LCD_FPA  (0x3A)
+#define LCD_BPA  (0x3A)
+#define LCD_LINES (160)
+#define LCD_FRAME_US ((uint32_t)((uint64_t)1000000 * (LCD_RTNA * 2 + 40) * \
+        (LCD_LINES + LCD_FPA + LCD_BPA + 2) / LCD_FOSC))
+
+// Front buffer is scanned out by the DMA, back buffer is drawn by the UI.
+// With the banked memory map both get SRAM3 to themselves, see memmap_fw.ld
+#if defined(LCD_LINE_MODE) || defined(LCD_INDEXED)
+// Lines are rendered into one buffer while the other one is being sent. The
+// rows of all windows are numbered in sending order, line n uses buffer n & 1.
+#define LCD_LINE_TX
+#define LCD_LINE_IRQ DMA_IRQ_0
+static uint16_t lcd_lines[2][LCD_WIDTH] __attribute__((aligned(4)));
+static lcd_line_fn_t lcd_line_fn;
+static uint16_t lcd_line_rows[LCD_MAX_WINDOWS * LCD_HEIGHT];
+static int lcd_line_count;
+static volatile int lcd_line_sent;
+#endif
+
+#ifdef LCD_INDEXED
+typedef uint8_t lcd_pixel_t;
+#define LCD_FB_SIZE (LCD_WIDTH * LCD_HEIGHT / 2)
+#define LCD_FB_OFFSET(o) ((o) / 2)
+#else
+typedef uint16_t lcd_pixel_t;
+#define LCD_FB_SIZE (LCD_WIDTH * LCD_HEIGHT)
+#define LCD_FB_OFFSET(o) (o)
+#endif
+
+#ifndef LCD_LINE_MODE
+#ifdef FW_SRAM_BANKED
+static lcd_pixel_t lcd_buffers[2][LCD_FB_SIZE]
+        __attribute__((section(".lcd_framebuffer")));
+#else
+static lcd_pixel_t lcd_buffers[2][LCD_FB_SIZE];
+#endif
+lcd_pixel_t *framebuffer = lcd_buffers[0];
+static lcd_pixel_t *lcd_front = lcd_buffers[1];
+#endif
+
+#ifdef LCD_INDEXED
+// Default palette, the 16 CGA colours
+static uint16_t lcd_palette[LCD_PALETTE_SIZE] = {
+    0x0000, 0x0015, 0x0540, 0x0555, 0xa800, 0xa815, 0xaaa0, 0xad55,
+    0x52aa, 0x52bf, 0x57ea, 0x57ff, 0xfaaa, 0xfabf, 0xffea, 0xffff,
+};
+// Both pixels of a framebuffer byte, low nibble in the low half-word
+static uint32_t lcd_palette_pairs[256];
+static uint16_t lcd_last_color;
+static uint8_t lcd_last_index;
+#endif
+#ifndef LCD_TE_PIN
+static absolute_time_t lcd_last_frame;
+#endif
+static volatile bool lcd_wait_frame;
+
+static uint lcd_sm;
 static int lcd_dma;
+static int lcd_ctrl_dma;
 static volatile bool lcd_busy;
-static volatile bool lcd_update_req;
+static bool lcd_held;
+static uint32_t lcd_frame_start;
+static lcd_stats_t lcd_stats;
+
+// Windows being sent by the DMA, and windows queued while it was busy. The
+// queue collapses into one bounding window if it overflows.
+static lcd_rect_t lcd_active[LCD_MAX_WINDOWS];
+static int lcd_active_count;
+static lcd_rect_t lcd_pending[LCD_MAX_WINDOWS];
+static volatile int lcd_pending_count;
+
+// PIO packets setting up each window: CASET, RASET, RAMWR and the pixel
+// data header. See lcd.pio for the packet format.
+#define LCD_WINDOW_WORDS (13)
+static uint32_t lcd_window_cmds[LCD_MAX_WINDOWS][LCD_WINDOW_WORDS];
+static const uint32_t lcd_end_marker = LCD_PIO_HDR_END;
+
+// Scroll area, see lcd_set_scroll(). The panel can only scroll along its gate
+// lines, which are LCD rows in vertical mode. Anything else is done by
+// permuting lines while sending.
+#define LCD_GRAM_LINES (162)
+typedef struct {
+	bool x_axis;
+	int top;
+	int height; // 0 if off
+	int offset;
+} lcd_scroll_t;
+static lcd_scroll_t lcd_scroll;
+static lcd_scroll_t lcd_scroll_next;
+static bool lcd_scroll_changed;
+// VSCRDEF and VSCSAD packets, or NORON when leaving hardware scrolling
+#define LCD_SCROLL_WORDS (10)
+static uint32_t lcd_scroll_cmds[LCD_SCROLL_WORDS];
+
+// Panel orientation, see lcd_set_orientation(). Flipping sets MADCTL MX and
+// MY, the windows then land on the other side of the GRAM.
+#ifdef LCD_HORIZONTAL
+#define LCD_GRAM_WIDTH (LCD_GRAM_LINES)
+#define LCD_GRAM_HEIGHT (132)
+static const uint8_t lcd_madctl[LCD_ORIENT_COUNT] = {0x78, 0xa8};
+#else
+#define LCD_GRAM_WIDTH (132)
+#define LCD_GRAM_HEIGHT (LCD_GRAM_LINES)
+static const uint8_t lcd_madctl[LCD_ORIENT_COUNT] = {0x08, 0xc8};
+#endif
+static lcd_orient_t lcd_orient;
+static lcd_orient_t lcd_orient_next;
+static bool lcd_orient_changed;
+// MADCTL packet
+#define LCD_ORIENT_WORDS (4)
+static uint32_t lcd_orient_cmds[LCD_ORIENT_WORDS];
+#ifdef LCD_LINE_TX
+static uint16_t lcd_line_tmp[LCD_WIDTH];
+#endif
+
+// DMA control blocks for a whole frame, written by lcd_ctrl_dma into the data
+// channel's alias 3 registers: {ctrl, write address, count, read address}.
+// One block for each window's commands, one per framebuffer row of the
+// window, then the end marker and a null block to stop the chain. Orientation
+// and scroll changes add one block each in front.
+// A software scrolled x-axis area turns the frame into one full-screen window
+// with up to 4 blocks per row, which also fits
+#define LCD_MAX_BLOCKS (LCD_MAX_WINDOWS * (LCD_HEIGHT + 1) + 4)
+static uint32_t lcd_cb[LCD_MAX_BLOCKS][4];
+static uint32_t lcd_ctrl_32;
+static uint32_t lcd_ctrl_16;
+#ifdef LCD_LINE_TX
+static uint32_t lcd_ctrl_line;
+#endif
+
+static void lcd_reset(void) {
+    gpio_put(LCD_RST, 0);
+    sleep_ms(200);
+    gpio_put(LCD_RST, 1);
+    sleep_ms(20);
+}
+
+static void lcd_pio_put(uint32_t word) {
+    pio_sm_put_blocking(LCD_PIO, lcd_sm, word);
+}
+
+static void lcd_send_cmd(uint8_t cmd) {
+    lcd_pio_put(LCD_PIO_HDR(0, 8));
+    lcd_pio_put((uint32_t)cmd << 24);
+}
+
+static void lcd_send_dat(uint8_t dat) {
+    lcd_pio_put(LCD_PIO_HDR(1, 8));
+    lcd_pio_put((uint32_t)dat << 24);
+}
+
+static void lcd_send_word(uint16_t word) {
+    lcd_pio_put(LCD_PIO_HDR(1, 16));
+    lcd_pio_put((uint32_t)word << 16);
+}
+
+// Wait until everything queued to the state machine has been clocked out
+static void lcd_pio_wait_idle(void) {
+    uint32_t stall = 1u << (PIO_FDEBUG_TXSTALL_LSB + lcd_sm);
+    while (!pio_sm_is_tx_fifo_empty(LCD_PIO, lcd_sm));
+    LCD_PIO->fdebug = stall;
+    while (!(LCD_PIO->fdebug & stall));
+}
+
+static void lcd_set_pio_clock(uint32_t freq) {
+    // SCK is half the state machine clock
+    pio_sm_set_clkdiv(LCD_PIO, lcd_sm,
+            (float)clock_get_hz(clk_sys) / (2.0f * freq));
+}
 
+#ifdef LCD_SPI_PROBE
 static void lcd_select(void) {
     gpio_put(LCD_CS, 0);
 }
@@ -54,119 +239,684 @@ static void lcd_mode_command(void) {
     gpio_put(LCD_RS, 0);
 }
 
-static void lcd_mode_data(void) {
-    gpio_put(LCD_RS, 1);
+static void lcd_bitbang_clock(void) {
+    busy_wait_us_32(1);
+    gpio_put(LCD_SCK, 1);
+    busy_wait_us_32(1);
 }
 
-static void lcd_reset(void) {
-    gpio_put(LCD_RST, 0);
-    sleep_ms(200);
-    gpio_put(LCD_RST, 1);
-    sleep_ms(20);
-}
+// Read a register back over the bidirectional SDA line. There is no MISO,
+// so the pins are taken from the PIO and the whole transfer is bit-banged.
+static uint32_t lcd_read_reg(uint8_t cmd, int bits, bool dummy) {
+    const uint32_t mask = (1u << LCD_CS) | (1u << LCD_RS) | (1u << LCD_SCK) |
+            (1u << LCD_MOSI);
+    uint32_t val = 0;
 
-static void lcd_send_byte(uint8_t byte) {
+    lcd_pio_wait_idle();
+    gpio_init_mask(mask);
+    gpio_set_dir_out_masked(mask);
+    gpio_put(LCD_SCK, 0);
+    lcd_mode_command();
     lcd_select();
-    spi_write_blocking(LCD_SPI, &byte, 1);
+    for (int i = 7; i >= 0; i--) {
+        gpio_put(LCD_SCK, 0);
+        gpio_put(LCD_MOSI, (cmd >> i) & 1);
+        lcd_bitbang_clock();
+    }
+    gpio_set_dir(LCD_MOSI, GPIO_IN);
+    if (dummy)
+        bits++;
+    for (int i = 0; i < bits; i++) {
+        gpio_put(LCD_SCK, 0);
+        lcd_bitbang_clock();
+        val = (val << 1) | gpio_get(LCD_MOSI);
+    }
+    gpio_put(LCD_SCK, 0);
     lcd_deselect();
+
+    pio_gpio_init(LCD_PIO, LCD_CS);
+    pio_gpio_init(LCD_PIO, LCD_RS);
+    pio_gpio_init(LCD_PIO, LCD_SCK);
+    pio_gpio_init(LCD_PIO, LCD_MOSI);
+    return dummy ? (val & ((1u << (bits - 1)) - 1)) : val;
 }
 
-static void lcd_send_cmd(uint8_t cmd) {
-    lcd_mode_command();
-    lcd_send_byte(cmd);
+// Write MADCTL at the current clock with varying patterns and check they
+// read back. MADCTL[1:0] are don't care.
+static bool lcd_spi_check(void) {
+    for (int i = 0; i < LCD_SPI_PROBE_ROUNDS; i++) {
+        uint8_t pattern = (uint8_t)(0xa5 ^ (i * 0x1c)) & 0xfc;
+        lcd_send_cmd(0x36);
+        lcd_send_dat(pattern);
+        if ((lcd_read_reg(0x0b, 8, false) & 0xfc) != pattern)
+            return false;
+    }
+    return true;
 }
 
-static void lcd_send_dat(uint8_t dat) {
-    lcd_mode_data();
-    lcd_send_byte(dat);
+// A failed write may have landed on another register, the rest of the init
+// sequence is sent after this so everything that matters gets rewritten
+static uint32_t lcd_spi_probe(void) {
+    // Step the divider by halves: 62.5, 41.7, 31.3, 25, 20.8 ... MHz
+    uint32_t sys = clock_get_hz(clk_sys);
+    for (uint32_t div2 = (sys + LCD_SPI_FREQ - 1) / LCD_SPI_FREQ; ; div2++) {
+        uint32_t freq = sys / div2;
+        if (freq <= LCD_SPI_FREQ_MIN)
+            break;
+        lcd_set_pio_clock(freq);
+        if (lcd_spi_check())
+            return freq;
+    }
+    lcd_set_pio_clock(LCD_SPI_FREQ_MIN);
+    return LCD_SPI_FREQ_MIN;
 }
+#endif
 
-static void lcd_send_word(uint16_t word) {
-    lcd_mode_data();
-    lcd_send_byte(word >> 8);
-    lcd_send_byte(word);
+static void lcd_cb_set(uint32_t *cb, uint32_t ctrl, uint32_t count,
+        const void *addr) {
+    cb[0] = ctrl;
+    cb[1] = (uint32_t)&LCD_PIO->txf[lcd_sm];
+    cb[2] = count;
+    cb[3] = (uint32_t)addr;
 }
 
-static void lcd_send_buffer() {
-    lcd_mode_data();
-    lcd_select();
-#if 0
-    spi_write_blocking(LCD_SPI, framebuffer, sizeof(framebuffer));
-    lcd_deselect();
+static bool lcd_scroll_hw(const lcd_scroll_t *s) {
+#ifdef LCD_VERTICAL
+	return s->height && !s->x_axis;
+#else
+	return false;
+#endif
+}
+
+static bool lcd_scroll_soft(void) {
+	return lcd_scroll.height && lcd_scroll.offset &&
+			!lcd_scroll_hw(&lcd_scroll);
+}
+
+// GRAM address of framebuffer column and row 0
+static int lcd_offset_x(lcd_orient_t orient) {
+	return (orient == LCD_ORIENT_FLIPPED) ?
+			(LCD_GRAM_WIDTH - LCD_WIDTH - LCD_OFFSET_X) : LCD_OFFSET_X;
+}
+
+static int lcd_offset_y(lcd_orient_t orient) {
+	return (orient == LCD_ORIENT_FLIPPED) ?
+			(LCD_GRAM_HEIGHT - LCD_HEIGHT - LCD_OFFSET_Y) : LCD_OFFSET_Y;
+}
+
+// Screen area covered by a scroll area
+static lcd_rect_t lcd_scroll_rect(const lcd_scroll_t *s) {
+	lcd_rect_t r = {0, 0, LCD_WIDTH - 1, LCD_HEIGHT - 1};
+	if (s->x_axis) {
+		r.x1 = s->top;
+		r.x2 = s->top + s->height - 1;
+	}
+	else {
+		r.y1 = s->top;
+		r.y2 = s->top + s->height - 1;
+	}
+	return r;
+}
+
+// Framebuffer line shown at line n along the scroll axis
+static int lcd_scroll_map(int n) {
+	const lcd_scroll_t *s = &lcd_scroll;
+	if ((n < s->top) || (n >= s->top + s->height))
+		return n;
+	return s->top + (n - s->top + s->offset) % s->height;
+}
+
+static bool lcd_rect_overlap(const lcd_rect_t *a, const lcd_rect_t *b) {
+	return (a->x1 <= b->x2) && (b->x1 <= a->x2) &&
+			(a->y1 <= b->y2) && (b->y1 <= a->y2);
+}
+
+// Software scrolling moves every pixel of the area on screen, so a window
+// touching it has to cover all of it. x-axis areas span every row and are
+// sent as the full screen, y-axis ones are merged with the windows they touch.
+static void lcd_scroll_windows(void) {
+	lcd_rect_t area = lcd_scroll_rect(&lcd_scroll);
+	bool hit = false;
+
+	if (lcd_scroll.x_axis) {
+		for (int i = 0; i < lcd_active_count; i++)
+			hit |= lcd_rect_overlap(&lcd_active[i], &area);
+		if (hit) {
+			lcd_active[0] = (lcd_rect_t){0, 0, LCD_WIDTH - 1, LCD_HEIGHT - 1};
+			lcd_active_count = 1;
+		}
+		return;
+	}
+	for (int i = 0; i < lcd_active_count; i++) {
+		if (!lcd_rect_overlap(&lcd_active[i], &area))
+			continue;
+		if (lcd_active[i].x1 < area.x1) area.x1 = lcd_active[i].x1;
+		if (lcd_active[i].y1 < area.y1) area.y1 = lcd_active[i].y1;
+		if (lcd_active[i].x2 > area.x2) area.x2 = lcd_active[i].x2;
+		if (lcd_active[i].y2 > area.y2) area.y2 = lcd_active[i].y2;
+		lcd_active[i--] = lcd_active[--lcd_active_count];
+		hit = true;
+	}
+	if (hit)
+		lcd_active[lcd_active_count++] = area;
+}
+
+// Packets applying a scroll area change, returns the number of words
+static int lcd_scroll_packets(uint32_t *p) {
+	const lcd_scroll_t *s = &lcd_scroll;
+	if (!lcd_scroll_hw(s)) {
+		// Back to normal display mode
+		p[0] = LCD_PIO_HDR(0, 8);
+		p[1] = 0x13 << 24;
+		return 2;
+	}
+	int tfa = s->top + lcd_offset_y(lcd_orient);
+	int start = tfa + s->offset;
+	if (lcd_orient == LCD_ORIENT_FLIPPED) {
+		// MY reverses the rows as they are written, the scroll registers
+		// count memory rows as the panel scans them. The area is mirrored
+		// and the lines turn the other way.
+		tfa = LCD_GRAM_HEIGHT - tfa - s->height;
+		start = tfa + (s->height - s->offset) % s->height;
+	}
+	p[0] = LCD_PIO_HDR(0, 8);
+	p[1] = 0x33 << 24;	// VSCRDEF
+	p[2] = LCD_PIO_HDR(1, 48);
+	p[3] = tfa << 16;
+	p[4] = s->height << 16;
+	p[5] = (LCD_GRAM_LINES - tfa - s->height) << 16;
+	p[6] = LCD_PIO_HDR(0, 8);
+	p[7] = 0x37 << 24;	// VSCSAD
+	p[8] = LCD_PIO_HDR(1, 16);
+	p[9] = start << 16;
+	return 10;
+}
+
+#ifndef LCD_LINE_TX
+static int lcd_emit_span(int blocks, int y, int x, int n) {
+	lcd_cb_set(lcd_cb[blocks++], lcd_ctrl_16, n, &lcd_front[y * LCD_WIDTH + x]);
+	return blocks;
+}
+
+// Blocks sending pixels x1..x2 of screen row y through the software scroll
+// mapping, returns the new block count
+static int lcd_emit_row(int blocks, int y, int x1, int x2) {
+	const lcd_scroll_t *s = &lcd_scroll;
+	if (!lcd_scroll_soft())
+		return lcd_emit_span(blocks, y, x1, x2 - x1 + 1);
+	if (!s->x_axis)
+		return lcd_emit_span(blocks, lcd_scroll_map(y), x1, x2 - x1 + 1);
+
+	int a = s->top;
+	int b = s->top + s->height;
+	if (x1 < a) {
+		int e = (x2 < a) ? x2 : (a - 1);
+		blocks = lcd_emit_span(blocks, y, x1, e - x1 + 1);
+		x1 = e + 1;
+	}
+	if ((x1 <= x2) && (x1 < b)) {
+		// Wraps around the end of the area at most once
+		int e = (x2 < b) ? x2 : (b - 1);
+		int n = e - x1 + 1;
+		int src = lcd_scroll_map(x1);
+		int first = (n < b - src) ? n : (b - src);
+		blocks = lcd_emit_span(blocks, y, src, first);
+		if (n > first)
+			blocks = lcd_emit_span(blocks, y, a, n - first);
+		x1 = e + 1;
+	}
+	if (x1 <= x2)
+		blocks = lcd_emit_span(blocks, y, x1, x2 - x1 + 1);
+	return blocks;
+}
+#endif
+
+// Build the control block chain for all active windows. Every packet for
+// the frame, commands and pixels alike, then goes out without the CPU.
+static void lcd_build_frame(void) {
+	int blocks = 0;
+
+#ifdef LCD_LINE_TX
+	lcd_line_count = 0;
+	lcd_line_sent = -1;
+#endif
+	if (lcd_orient_changed) {
+		lcd_orient_changed = false;
+		lcd_orient_cmds[0] = LCD_PIO_HDR(0, 8);
+		lcd_orient_cmds[1] = 0x36 << 24;	// MADCTL
+		lcd_orient_cmds[2] = LCD_PIO_HDR(1, 8);
+		lcd_orient_cmds[3] = (uint32_t)lcd_madctl[lcd_orient] << 24;
+		lcd_cb_set(lcd_cb[blocks++], lcd_ctrl_32, LCD_ORIENT_WORDS,
+				lcd_orient_cmds);
+	}
+	if (lcd_scroll_changed) {
+		lcd_scroll_changed = false;
+		int words = lcd_scroll_packets(lcd_scroll_cmds);
+		lcd_cb_set(lcd_cb[blocks++], lcd_ctrl_32, words, lcd_scroll_cmds);
+	}
+	if (lcd_scroll_soft())
+		lcd_scroll_windows();
+	int offset_x = lcd_offset_x(lcd_orient);
+	int offset_y = lcd_offset_y(lcd_orient);
+	for (int i = 0; i < lcd_active_count; i++) {
+		lcd_rect_t *r = &lcd_active[i];
+#ifdef LCD_LINE_TX
+		// Lines narrower than the full width leave the interrupt too little
+		// time to render the next one
+		r->x1 = 0;
+		r->x2 = LCD_WIDTH - 1;
+#endif
+		uint32_t width = r->x2 - r->x1 + 1;
+		uint32_t pixels = width * (r->y2 - r->y1 + 1);
+		uint32_t *p = lcd_window_cmds[i];
+
+		p[0] = LCD_PIO_HDR(0, 8);
+		p[1] = 0x2a << 24;
+		p[2] = LCD_PIO_HDR(1, 32);
+		p[3] = (r->x1 + offset_x) << 16;
+		p[4] = (r->x2 + offset_x) << 16;
+		p[5] = LCD_PIO_HDR(0, 8);
+		p[6] = 0x2b << 24;
+		p[7] = LCD_PIO_HDR(1, 32);
+		p[8] = (r->y1 + offset_y) << 16;
+		p[9] = (r->y2 + offset_y) << 16;
+		p[10] = LCD_PIO_HDR(0, 8);
+		p[11] = 0x2c << 24;
+		p[12] = LCD_PIO_HDR(1, pixels * 16);
+		lcd_cb_set(lcd_cb[blocks++], lcd_ctrl_32, LCD_WINDOW_WORDS, p);
+
+#ifdef LCD_LINE_TX
+		// One block per row, each raising an interrupt when done so the
+		// buffer it used can be refilled
+		for (int y = r->y1; y <= r->y2; y++) {
+			lcd_cb_set(lcd_cb[blocks++], lcd_ctrl_line, width,
+					&lcd_lines[lcd_line_count & 1][r->x1]);
+			lcd_line_rows[lcd_line_count++] = y;
+		}
 #else
-	// Don't start until the last transmission has finished
-	lcd_update_req = 1;
-	if (!lcd_busy) {
-		lcd_update_req = 0;
-		lcd_busy = true;
-		dma_channel_set_read_addr(lcd_dma, framebuffer, false);
-		dma_channel_set_trans_count(lcd_dma, sizeof(framebuffer), true);
+		if ((width == LCD_WIDTH) && !lcd_scroll_soft()) {
+			// Full rows are contiguous in the framebuffer
+			lcd_cb_set(lcd_cb[blocks++], lcd_ctrl_16, pixels,
+					&lcd_front[r->y1 * LCD_WIDTH]);
+		}
+		else {
+			for (int y = r->y1; y <= r->y2; y++)
+				blocks = lcd_emit_row(blocks, y, r->x1, r->x2);
+		}
+#endif
+	}
+	lcd_cb_set(lcd_cb[blocks++], lcd_ctrl_32, 1, &lcd_end_marker);
+	lcd_cb_set(lcd_cb[blocks], lcd_ctrl_32, 0, NULL);
+}
+
+#ifdef LCD_LINE_MODE
+void lcd_set_line_fn(lcd_line_fn_t fn) {
+	lcd_line_fn = fn;
+}
+#endif
+
+#ifdef LCD_INDEXED
+void lcd_set_palette(const uint16_t *palette) {
+	for (int i = 0; i < LCD_PALETTE_SIZE; i++)
+		lcd_palette[i] = palette[i];
+	for (int i = 0; i < 256; i++)
+		lcd_palette_pairs[i] = lcd_palette[i & 0xf] |
+				((uint32_t)lcd_palette[i >> 4] << 16);
+	lcd_last_color = lcd_palette[0];
+	lcd_last_index = 0;
+}
+
+// Exact match first, the UI mostly uses palette colours, then the closest
+// entry by squared RGB distance
+uint8_t lcd_color_index(uint16_t c) {
+	if (c == lcd_last_color)
+		return lcd_last_index;
+
+	int best = 0;
+	int best_dist = INT_MAX;
+	for (int i = 0; i < LCD_PALETTE_SIZE; i++) {
+		uint16_t p = lcd_palette[i];
+		if (p == c) {
+			best = i;
+			break;
+		}
+		// Compare in 6-bit units for all three components
+		int dr = (int)((p >> 11) - (c >> 11)) * 2;
+		int dg = (int)((p >> 5) & 0x3f) - (int)((c >> 5) & 0x3f);
+		int db = (int)((p & 0x1f) - (c & 0x1f)) * 2;
+		int dist = dr * dr + dg * dg + db * db;
+		if (dist < best_dist) {
+			best = i;
+			best_dist = dist;
+		}
 	}
+	lcd_last_color = c;
+	lcd_last_index = best;
+	return best;
+}
+
+// lcd_line_fn_t, expand one row of the front buffer two pixels at a time
+static void lcd_expand_line(int line, uint16_t *buf) {
+	const uint8_t *src = &lcd_front[line * LCD_WIDTH / 2];
+	uint32_t *dst = (uint32_t *)buf;
+	for (int i = 0; i < LCD_WIDTH / 2; i++)
+		dst[i] = lcd_palette_pairs[src[i]];
+}
 #endif
+
+#ifdef LCD_LINE_TX
+// Render screen line n through the software scroll mapping
+static void lcd_render_line(int n, uint16_t *buf) {
+	const lcd_scroll_t *s = &lcd_scroll;
+	if (!lcd_scroll_soft()) {
+		lcd_line_fn(n, buf);
+	}
+	else if (!s->x_axis) {
+		lcd_line_fn(lcd_scroll_map(n), buf);
+	}
+	else {
+		int a = s->top;
+		int first = s->height - s->offset;
+		lcd_line_fn(n, lcd_line_tmp);
+		memcpy(buf, lcd_line_tmp, LCD_WIDTH * 2);
+		memcpy(&buf[a], &lcd_line_tmp[a + s->offset], first * 2);
+		memcpy(&buf[a + first], &lcd_line_tmp[a], s->offset * 2);
+	}
 }
 
-// This interrupt should be at the lowest priority
-static void lcd_dma_isr() {
+// Line n has been sent and n + 1 is going out from the other buffer, render
+// n + 2 into the one just freed. The null trigger ending the chain also
+// lands here, with no line left to render.
+static void lcd_line_isr() {
+	uint32_t start = time_us_32();
 	dma_hw->ints0 = 1u << lcd_dma;
-	// Wait till the FIFO is drained and all bytes are sent
-	while ((spi_get_hw(LCD_SPI)->sr & SPI_SSPSR_BSY_BITS));
-	lcd_deselect();
-	lcd_busy = false;
-	if (lcd_update_req) {
-		lcd_update_req = 0;
-		lcd_send_buffer();
+	int next = ++lcd_line_sent + 2;
+	if (next < lcd_line_count)
+		lcd_render_line(lcd_line_rows[next], lcd_lines[next & 1]);
+	uint32_t isr_us = time_us_32() - start;
+	if (isr_us > lcd_stats.isr_us_max)
+		lcd_stats.isr_us_max = isr_us;
+}
+#endif
+
+static void lcd_kick(void) {
+#ifdef LCD_LINE_TX
+	for (int i = 0; (i < 2) && (i < lcd_line_count); i++)
+		lcd_render_line(lcd_line_rows[i], lcd_lines[i]);
+#endif
+	lcd_frame_start = time_us_32();
+	TRACE(TRACE_LCD_DMA_START, lcd_active_count);
+	dma_channel_set_read_addr(lcd_ctrl_dma, lcd_cb, true);
+}
+
+#ifdef LCD_TE_PIN
+// TE goes high at the start of vertical blanking
+static void lcd_te_isr(uint gpio, uint32_t events) {
+	if (lcd_wait_frame) {
+		lcd_wait_frame = false;
+		lcd_kick();
+	}
+}
+#else
+static int64_t lcd_frame_alarm(alarm_id_t id, void *user_data) {
+	lcd_wait_frame = false;
+	lcd_kick();
+	return 0;
+}
+#endif
+
+// Start scanning out the front buffer at the next frame boundary
+static void lcd_start_frame(void) {
+#ifdef LCD_TE_PIN
+	lcd_wait_frame = true;
+#else
+	// No phase information, only pace swaps to one per panel refresh
+	absolute_time_t next = delayed_by_us(lcd_last_frame, LCD_FRAME_US);
+	if (time_reached(next)) {
+		lcd_last_frame = get_absolute_time();
+		lcd_kick();
+	}
+	else {
+		lcd_last_frame = next;
+		lcd_wait_frame = true;
+		if (add_alarm_at(next, lcd_frame_alarm, NULL, true) < 0) {
+			// Nothing would ever start the frame, send it now and risk
+			// tearing rather than leave the LCD busy for good
+			lcd_wait_frame = false;
+			lcd_stats.unpaced++;
+			lcd_kick();
+		}
+	}
+#endif
+}
+
+#ifndef LCD_LINE_MODE
+// Copy the given windows from the front buffer to the back buffer
+static void lcd_sync_back(const lcd_rect_t *rects, int count) {
+	for (int i = 0; i < count; i++) {
+		const lcd_rect_t *r = &rects[i];
+		size_t len = LCD_FB_OFFSET(r->x2 - r->x1 + 1) * sizeof(lcd_pixel_t);
+		for (int y = r->y1; y <= r->y2; y++) {
+			size_t offset = LCD_FB_OFFSET(y * LCD_WIDTH + r->x1);
+			memcpy(&framebuffer[offset], &lcd_front[offset], len);
+		}
 	}
 }
+#endif
+
+// Swap buffers and send the pending windows, if the previous frame is done
+// and no background drawing is still going into the back buffer
+void lcd_poll(void) {
+#ifdef LCD_LINE_MODE
+	if (lcd_busy || lcd_held || !(lcd_pending_count || lcd_scroll_changed))
+		return;
+
+	uint32_t save = save_and_disable_interrupts();
+#else
+	if (lcd_busy || lcd_held || !(lcd_pending_count || lcd_scroll_changed) ||
+			gfx_busy())
+		return;
+
+	uint32_t save = save_and_disable_interrupts();
+	lcd_pixel_t *back = lcd_front;
+	lcd_front = framebuffer;
+	framebuffer = back;
+#endif
+	lcd_scroll = lcd_scroll_next;
+	lcd_orient = lcd_orient_next;
+	for (int i = 0; i < lcd_pending_count; i++)
+		lcd_active[i] = lcd_pending[i];
+	lcd_active_count = lcd_pending_count;
+	lcd_pending_count = 0;
+	lcd_busy = true;
+	restore_interrupts(save);
+
+	lcd_build_frame();
+	lcd_start_frame();
+#ifndef LCD_LINE_MODE
+	// The DMA only reads the front buffer, safe to copy while it runs
+	lcd_sync_back(lcd_active, lcd_active_count);
+#endif
+}
+
+// Keep lcd_poll() from starting frames while the back buffer has drawing
+// that is not queued yet, like an update cut short by its time slice. A swap
+// would leave that drawing behind, lcd_sync_back() only copies the windows
+// being sent. Queued windows wait until the hold is lifted.
+void lcd_hold(bool hold) {
+	lcd_held = hold;
+}
+
+static void lcd_queue_rect(const lcd_rect_t *rect) {
+	if (lcd_pending_count < LCD_MAX_WINDOWS) {
+		lcd_pending[lcd_pending_count++] = *rect;
+		return;
+	}
+	// Out of slots, send everything as one bounding window
+	lcd_rect_t *b = &lcd_pending[0];
+	for (int i = 1; i < lcd_pending_count; i++) {
+		if (lcd_pending[i].x1 < b->x1) b->x1 = lcd_pending[i].x1;
+		if (lcd_pending[i].y1 < b->y1) b->y1 = lcd_pending[i].y1;
+		if (lcd_pending[i].x2 > b->x2) b->x2 = lcd_pending[i].x2;
+		if (lcd_pending[i].y2 > b->y2) b->y2 = lcd_pending[i].y2;
+	}
+	if (rect->x1 < b->x1) b->x1 = rect->x1;
+	if (rect->y1 < b->y1) b->y1 = rect->y1;
+	if (rect->x2 > b->x2) b->x2 = rect->x2;
+	if (rect->y2 > b->y2) b->y2 = rect->y2;
+	lcd_pending_count = 1;
+}
+
+// Scroll the area along the given axis so that its line top + offset shows
+// first. Drawing is not affected, the framebuffer keeps its layout and the
+// lines are rotated on the way out, by the panel itself when it can.
+void lcd_set_scroll(bool x_axis, int top, int height, int offset) {
+	lcd_scroll_t *s = &lcd_scroll_next;
+	if (height)
+		offset = ((offset % height) + height) % height;
+	else
+		offset = 0;
+	if ((s->x_axis == x_axis) && (s->top == top) && (s->height == height) &&
+			(s->offset == offset))
+		return;
+	bool was_hw = lcd_scroll_hw(s);
+	if (s->height && !was_hw && ((s->x_axis != x_axis) ||
+			(s->top != top) || (s->height != height))) {
+		// Put back what the old area covered
+		lcd_rect_t area = lcd_scroll_rect(s);
+		lcd_queue_rect(&area);
+	}
+	s->x_axis = x_axis;
+	s->top = top;
+	s->height = height;
+	s->offset = offset;
+	if (lcd_scroll_hw(s) || was_hw) {
+		lcd_scroll_changed = true;
+	}
+	else if (height) {
+		lcd_rect_t area = lcd_scroll_rect(s);
+		lcd_queue_rect(&area);
+	}
+}
+
+// Turn the picture upside down, or back, from the next frame on. Only the
+// panel's address order changes: the framebuffer layout, drawing and the
+// bytes sent stay the same, so it costs nothing once done. Hardware scroll
+// areas stay in hardware, mirrored, see lcd_scroll_packets().
+void lcd_set_orientation(lcd_orient_t orient) {
+	if ((orient >= LCD_ORIENT_COUNT) || (orient == lcd_orient_next))
+		return;
+	lcd_orient_next = orient;
+	lcd_orient_changed = true;
+	if (lcd_scroll_hw(&lcd_scroll_next))
+		lcd_scroll_changed = true;
+	// The GRAM keeps the old picture, send all of it again
+	lcd_rect_t all = {0, 0, LCD_WIDTH - 1, LCD_HEIGHT - 1};
+	lcd_queue_rect(&all);
+}
+
+lcd_orient_t lcd_get_orientation(void) {
+	return lcd_orient_next;
+}
+
+// This interrupt should be at the lowest priority. The state machine raises
+// it on the end marker, after the last pixel has been clocked out and CS
+// released, so there is nothing left to wait for.
+static void lcd_pio_isr() {
+	uint32_t start = time_us_32();
+	pio_interrupt_clear(LCD_PIO, 0);
+	TRACE(TRACE_LCD_DMA_DONE, 0);
+	lcd_stats.frames++;
+	lcd_stats.push_us = start - lcd_frame_start;
+	if (lcd_stats.push_us > lcd_stats.push_us_max)
+		lcd_stats.push_us_max = lcd_stats.push_us;
+	lcd_busy = false;
+	uint32_t isr_us = time_us_32() - start;
+	if (isr_us > lcd_stats.isr_us_max)
+		lcd_stats.isr_us_max = isr_us;
+}
 
 void lcd_init(void) {
     // Configure Pins
 	gpio_set_function(LCD_BL,   GPIO_FUNC_SIO);
 	gpio_set_function(LCD_RST,  GPIO_FUNC_SIO);
-	gpio_set_function(LCD_RS,   GPIO_FUNC_SIO);
-    gpio_set_function(LCD_CS,   GPIO_FUNC_SIO);
-    gpio_set_function(LCD_SCK,  GPIO_FUNC_SPI);
-    gpio_set_function(LCD_MOSI, GPIO_FUNC_SPI);
 
-	lcd_deselect();
 	gpio_put(LCD_BL, 0);
 	gpio_set_dir(LCD_BL,  GPIO_OUT);
 	gpio_set_dir(LCD_RST, GPIO_OUT);
-	gpio_set_dir(LCD_RS,  GPIO_OUT);
-	gpio_set_dir(LCD_CS,  GPIO_OUT);
 
-    // Configure SPI
-    spi_init(LCD_SPI, LCD_SPI_FREQ);
+    // Configure PIO, stay within spec until the clock has been probed
+	lcd_sm = pio_claim_unused_sm(LCD_PIO, true);
+	uint offset = pio_add_program(LCD_PIO, &lcd_program);
+	lcd_program_init(LCD_PIO, lcd_sm, offset, LCD_MOSI, LCD_RS, LCD_CS, 1.0f);
+#ifdef LCD_SPI_PROBE
+	lcd_set_pio_clock(LCD_SPI_FREQ_MIN);
+#else
+	lcd_set_pio_clock(LCD_SPI_FREQ);
+#endif
+	pio_set_irq0_source_enabled(LCD_PIO, pis_interrupt0, true);
+	irq_set_exclusive_handler(LCD_PIO_IRQ, lcd_pio_isr);
+	irq_set_enabled(LCD_PIO_IRQ, true);
 
     // Set up DMA
 	lcd_dma = dma_claim_unused_channel(true);
+	lcd_ctrl_dma = dma_claim_unused_channel(true);
 	dma_channel_config c = dma_channel_get_default_config(lcd_dma);
-	channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
-	channel_config_set_dreq(&c, LCD_SPI_DREQ);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+	channel_config_set_dreq(&c, pio_get_dreq(LCD_PIO, lcd_sm, true));
 	channel_config_set_read_increment(&c, true);
 	channel_config_set_write_increment(&c, false);
-	dma_channel_configure(lcd_dma, &c, &spi_get_hw(LCD_SPI)->dr, framebuffer,
-			sizeof(framebuffer), false);
+	channel_config_set_chain_to(&c, lcd_ctrl_dma);
+	channel_config_set_irq_quiet(&c, true);
+	lcd_ctrl_32 = channel_config_get_ctrl_value(&c);
+	// 16-bit writes are replicated to both halves of the FIFO word
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+	lcd_ctrl_16 = channel_config_get_ctrl_value(&c);
+#ifdef LCD_INDEXED
+	lcd_set_palette(lcd_palette);
+	lcd_line_fn = lcd_expand_line;
+#endif
+#ifdef LCD_LINE_TX
+	channel_config_set_irq_quiet(&c, false);
+	lcd_ctrl_line = channel_config_get_ctrl_value(&c);
+	// Rendering has a line's worth of time, it goes ahead of everything
 	dma_channel_set_irq0_enabled(lcd_dma, true);
-	irq_set_exclusive_handler(DMA_IRQ_0, lcd_dma_isr);
-	irq_set_enabled(DMA_IRQ_0, true);
+	irq_set_exclusive_handler(LCD_LINE_IRQ, lcd_line_isr);
+	irq_set_priority(LCD_LINE_IRQ, PICO_HIGHEST_IRQ_PRIORITY);
+	irq_set_enabled(LCD_LINE_IRQ, true);
+#endif
 
-    // Reset LCD
-    lcd_deselect();
+	// Control channel writes 4-word blocks into the data channel, the write
+	// ring wraps back to the CTRL register after each block
+	c = dma_channel_get_default_config(lcd_ctrl_dma);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+	channel_config_set_read_increment(&c, true);
+	channel_config_set_write_increment(&c, true);
+	channel_config_set_ring(&c, true, 4);
+	dma_channel_configure(lcd_ctrl_dma, &c,
+			&dma_hw->ch[lcd_dma].al3_ctrl, lcd_cb, 4, false);
 
+    // Reset LCD
     lcd_reset();
 
     // Send initialization sequence 
 	lcd_send_cmd(0x11);	// turn off sleep mode
 	sleep_ms(100);
 
+#ifdef LCD_SPI_PROBE
+	lcd_stats.spi_freq = lcd_spi_probe();
+#else
+	lcd_stats.spi_freq = LCD_SPI_FREQ;
+#endif
+
 	lcd_send_cmd(0x21);	// display inversion mode
 
 	lcd_send_cmd(0xB1);	// Set the frame frequency of the full colors normal mode
 						// Frame rate=fosc/((RTNA x 2 + 40) x (LINE + FPA + BPA +2))
 						// fosc = 850kHz
-	lcd_send_dat(0x05);	// RTNA
-	lcd_send_dat(0x3A);	// FPA
-	lcd_send_dat(0x3A);	// BPA
+	lcd_send_dat(LCD_RTNA);	// RTNA
+	lcd_send_dat(LCD_FPA);	// FPA
+	lcd_send_dat(LCD_BPA);	// BPA
 
 	lcd_send_cmd(0xB2);	// Set the frame frequency of the Idle mode
 						// Frame rate=fosc/((RTNB x 2 + 40) x (LINE + FPB + BPB +2))
@@ -248,33 +998,62 @@ void lcd_init(void) {
 	lcd_send_cmd(0x3A);	// define the format of RGB picture data
 	lcd_send_dat(0x05);	// 16-bit/pixel
 
-	lcd_send_cmd(0x36);
-#ifdef LCD_HORIZONTAL
-	lcd_send_dat(0x78); // 0x08 0xc8 0x78 0xa8, direction control
-#else
-	lcd_send_dat(0x08);
+	lcd_send_cmd(0x36);	// direction control
+	lcd_orient = lcd_orient_next;
+	lcd_orient_changed = false;
+	lcd_send_dat(lcd_madctl[lcd_orient]);
+
+#ifdef LCD_TE_PIN
+	lcd_send_cmd(0x35);	// Tearing effect line on, V-blanking only
+	lcd_send_dat(0x00);
+	gpio_init(LCD_TE_PIN);
+	gpio_set_dir(LCD_TE_PIN, GPIO_IN);
+	gpio_set_irq_enabled_with_callback(LCD_TE_PIN, GPIO_IRQ_EDGE_RISE, true,
+			lcd_te_isr);
 #endif
 
 	lcd_send_cmd(0x29);	// Display On
 
-    lcd_set_window(0, 0, LCD_WIDTH - 1, LCD_HEIGHT - 1);
-
 	lcd_busy = false;
-	lcd_update_req = false;
+	lcd_wait_frame = false;
+	lcd_pending_count = 0;
+#ifndef LCD_TE_PIN
+	lcd_last_frame = get_absolute_time();
+#endif
 
 	gpio_put(LCD_BL, 1);
 }
 
 void lcd_set_window(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2) {
     lcd_send_cmd(0x2a);
-    lcd_send_word(x1 + LCD_OFFSET_X);
-    lcd_send_word(x2 + LCD_OFFSET_X);
+    lcd_send_word(x1 + lcd_offset_x(lcd_orient));
+    lcd_send_word(x2 + lcd_offset_x(lcd_orient));
     lcd_send_cmd(0x2b);
-    lcd_send_word(y1 + LCD_OFFSET_Y);
-    lcd_send_word(y2 + LCD_OFFSET_Y);
+    lcd_send_word(y1 + lcd_offset_y(lcd_orient));
+    lcd_send_word(y2 + lcd_offset_y(lcd_orient));
     lcd_send_cmd(0x2c);
 }
 
+// Present the back buffer, sending only the given windows. If the previous
+// frame is still going out they are queued and presented by lcd_poll().
+// Drawing into framebuffer may continue right away either way. In line mode
+// the windows are re-rendered from the line callback instead.
+void lcd_update_rects(const lcd_rect_t *rects, int count) {
+    for (int i = 0; i < count; i++)
+        lcd_queue_rect(&rects[i]);
+    lcd_poll();
+}
+
 void lcd_update(void) {
-    lcd_send_buffer();
+    lcd_rect_t full = {0, 0, LCD_WIDTH - 1, LCD_HEIGHT - 1};
+    lcd_update_rects(&full, 1);
 }
+
+bool lcd_is_busy(void) {
+    return lcd_busy || lcd_pending_count;
+}
+
+const lcd_stats_t *lcd_get_stats(void) {
+    return &lcd_stats;
+}
+
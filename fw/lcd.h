@@ -21,11 +21,22 @@
 //
 #pragma once
 
+#include <stdint.h>
+#include <stdbool.h>
+
 // Using horizontal mode causes visible diagnal image tearing. Using vertical
-// mode only produces verital image tearing, which is less perceptiable.
+// mode only produces verital image tearing, which is less perceptiable. The
+// framebuffer is double buffered and swaps are synchronized to the panel
+// refresh, see LCD_TE_PIN in lcd.c.
+//
+// Turning the screen by 90 degrees changes the framebuffer shape and the UI
+// geometry, so it stays a build option here and ROTATE_UI in ui.h. Turning
+// it upside down is a runtime setting, see lcd_set_orientation().
 
+#if !defined(LCD_HORIZONTAL) && !defined(LCD_VERTICAL)
 //#define LCD_HORIZONTAL
 #define LCD_VERTICAL
+#endif
 
 #ifdef LCD_HORIZONTAL
 #define LCD_WIDTH (160)
@@ -39,8 +50,94 @@
 #define LCD_OFFSET_Y (1)
 #endif
 
-extern uint16_t framebuffer[LCD_WIDTH * LCD_HEIGHT];
+typedef enum {
+    LCD_ORIENT_NORMAL = 0,
+    LCD_ORIENT_FLIPPED,     // Turned by 180 degrees
+    LCD_ORIENT_COUNT
+} lcd_orient_t;
+
+// No framebuffer: pixels are generated a line at a time by a callback while
+// the frame goes out, see lcd_set_line_fn(). Saves both framebuffers, used
+// by the UI character-cell mode.
+//#define LCD_LINE_MODE
+
+// Framebuffer of 4-bit palette indices instead of RGB565, two pixels per
+// byte with the left one in the low nibble. Both buffers together take
+// 12.8 KB instead of 51.2 KB. Lines are expanded to RGB565 through a
+// pixel-pair lookup table while they are sent, the same way LCD_LINE_MODE
+// renders them. Expanding an 80 pixel line is 40 table reads, well inside
+// the ~20us it takes to send it at 62.5 MHz. BENCH_LCD_PUSH reports the
+// worst case against the line time. Drawing goes through lcd_fb_put() and
+// the colours passed in are mapped to the nearest palette entry.
+//#define LCD_INDEXED
+
+#if defined(LCD_LINE_MODE) && defined(LCD_INDEXED)
+#error "LCD_LINE_MODE and LCD_INDEXED are exclusive"
+#endif
+
+// Maximum number of windows sent per update
+#define LCD_MAX_WINDOWS (4)
+
+// Inclusive framebuffer coordinates
+typedef struct {
+    uint16_t x1;
+    uint16_t y1;
+    uint16_t x2;
+    uint16_t y2;
+} lcd_rect_t;
+
+#ifdef LCD_LINE_MODE
+// Fill buf with the LCD_WIDTH pixels of the given line. Called from the DMA
+// interrupt, must take less time than sending one line.
+typedef void (*lcd_line_fn_t)(int line, uint16_t *buf);
+void lcd_set_line_fn(lcd_line_fn_t fn);
+#elif defined(LCD_INDEXED)
+// Back buffer, always safe to draw into. Changes when buffers are swapped.
+extern uint8_t *framebuffer;
+
+#define LCD_PALETTE_SIZE (16)
+void lcd_set_palette(const uint16_t *palette);
+uint8_t lcd_color_index(uint16_t c);
+
+// Framebuffer value for an RGB565 colour
+#define LCD_FB_COLOR(c) lcd_color_index(c)
+
+// Store a framebuffer value at a pixel offset (y * LCD_WIDTH + x)
+static inline void lcd_fb_put(uint32_t offset, uint16_t v) {
+    uint8_t *p = &framebuffer[offset >> 1];
+    if (offset & 1)
+        *p = (*p & 0x0f) | (v << 4);
+    else
+        *p = (*p & 0xf0) | v;
+}
+#else
+// Back buffer, always safe to draw into. Changes when buffers are swapped.
+extern uint16_t *framebuffer;
+
+#define LCD_FB_COLOR(c) (c)
+
+static inline void lcd_fb_put(uint32_t offset, uint16_t v) {
+    framebuffer[offset] = v;
+}
+#endif
+
+typedef struct {
+    uint32_t spi_freq;      // Serial clock in use, after probing
+    uint32_t frames;        // Frames presented
+    uint32_t push_us;       // Last frame, scan-out start to bus idle
+    uint32_t push_us_max;
+    uint32_t isr_us_max;    // Longest DMA completion ISR
+    uint32_t unpaced;       // Frames sent at once, no alarm slot was free
+} lcd_stats_t;
 
 void lcd_init(void);
 void lcd_set_window(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
-void lcd_update(void);
\ No newline at end of file
+void lcd_update(void);
+void lcd_update_rects(const lcd_rect_t *rects, int count);
+void lcd_set_scroll(bool x_axis, int top, int height, int offset);
+void lcd_set_orientation(lcd_orient_t orient);
+lcd_orient_t lcd_get_orientation(void);
+void lcd_poll(void);
+void lcd_hold(bool hold);
+bool lcd_is_busy(void);
+const lcd_stats_t *lcd_get_stats(void);
@@ -0,0 +1,166 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/uart.h"
+#include "fmt.h"
+#include "logstream.h"
+#include "trace.h"
+
+#if LOGSTREAM_SINK == LOGSTREAM_SINK_USB
+#include "tusb.h"
+#endif
+
+#if (LOGSTREAM_SINK == LOGSTREAM_SINK_UART) && (TRACE_SINK == TRACE_SINK_UART)
+#error "The UART log stream and the UART trace sink share the UART"
+#endif
+
+static logstream_stats_t stats;
+
+#if LOGSTREAM_SINK != LOGSTREAM_SINK_NONE
+
+// Only the main loop writes and drains, free running indices
+static uint8_t fifo[LOGSTREAM_FIFO_SIZE];
+static uint32_t fifo_wr;
+static uint32_t fifo_rd;
+static uint32_t pending_drop;
+
+static void logstream_put(const char *data, int length) {
+    uint32_t pos = fifo_wr & (LOGSTREAM_FIFO_SIZE - 1);
+    int first = LOGSTREAM_FIFO_SIZE - pos;
+    if (first > length)
+        first = length;
+    memcpy(&fifo[pos], data, first);
+    memcpy(fifo, data + first, length - first);
+    fifo_wr += length;
+}
+
+// Queue one log line, a CR LF replaces the trailing newline if there is one
+void logstream_write(const char *text, int length) {
+    char marker[24];
+    int marker_length = 0;
+
+    while ((length > 0) && (text[length - 1] == '\n'))
+        length--;
+    if (pending_drop)
+        marker_length = fmt_snprintf(marker, sizeof(marker),
+                "[%u dropped]\r\n", pending_drop);
+
+    uint32_t room = LOGSTREAM_FIFO_SIZE - (fifo_wr - fifo_rd);
+    if ((uint32_t)(marker_length + length + 2) > room) {
+        pending_drop++;
+        stats.dropped++;
+        stats.dropped_bytes += length + 2;
+        return;
+    }
+    if (marker_length) {
+        logstream_put(marker, marker_length);
+        pending_drop = 0;
+    }
+    logstream_put(text, length);
+    logstream_put("\r\n", 2);
+    stats.lines++;
+    if ((fifo_wr - fifo_rd) > stats.high_water)
+        stats.high_water = fifo_wr - fifo_rd;
+}
+
+// Bytes that can be read from the FIFO in one go
+static uint32_t logstream_contiguous(void) {
+    uint32_t pos = fifo_rd & (LOGSTREAM_FIFO_SIZE - 1);
+    uint32_t length = fifo_wr - fifo_rd;
+    if (length > LOGSTREAM_FIFO_SIZE - pos)
+        length = LOGSTREAM_FIFO_SIZE - pos;
+    return length;
+}
+
+#else
+
+void logstream_write(const char *text, int length) {
+}
+
+#endif
+
+#if LOGSTREAM_SINK == LOGSTREAM_SINK_UART
+static int logstream_dma;
+static uint32_t dma_length;
+
+void logstream_poll(void) {
+    if (dma_channel_is_busy(logstream_dma))
+        return;
+    fifo_rd += dma_length;
+    stats.bytes += dma_length;
+    dma_length = logstream_contiguous();
+    if (dma_length)
+        dma_channel_transfer_from_buffer_now(logstream_dma,
+                &fifo[fifo_rd & (LOGSTREAM_FIFO_SIZE - 1)], dma_length);
+}
+
+void logstream_init(void) {
+    uart_init(LOGSTREAM_UART, LOGSTREAM_UART_BAUD);
+    gpio_set_function(LOGSTREAM_UART_TX, GPIO_FUNC_UART);
+
+    logstream_dma = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(logstream_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, uart_get_dreq(LOGSTREAM_UART, true));
+    dma_channel_configure(logstream_dma, &c, &uart_get_hw(LOGSTREAM_UART)->dr,
+            fifo, 0, false);
+    dma_length = 0;
+}
+
+#elif LOGSTREAM_SINK == LOGSTREAM_SINK_USB
+
+void logstream_poll(void) {
+    tud_task();
+    // Keep the lines until a terminal opens the port
+    if (!tud_cdc_connected())
+        return;
+    uint32_t length = logstream_contiguous();
+    if (length) {
+        length = tud_cdc_write(&fifo[fifo_rd & (LOGSTREAM_FIFO_SIZE - 1)],
+                length);
+        fifo_rd += length;
+        stats.bytes += length;
+    }
+    tud_cdc_write_flush();
+}
+
+void logstream_init(void) {
+    tusb_init();
+}
+
+#else
+
+void logstream_poll(void) {
+}
+
+void logstream_init(void) {
+}
+
+#endif
+
+const logstream_stats_t *logstream_get_stats(void) {
+    return &stats;
+}
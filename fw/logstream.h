@@ -0,0 +1,62 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#pragma once
+
+#include <stdint.h>
+
+// Streams every syslog line to an external channel, for soak tests that run
+// at full verbosity. Lines are copied into a byte FIFO as they reach the log
+// and logstream_poll() drains it from the main loop, never blocking:
+//   UART: one DMA transfer at a time from the FIFO to the UART TX FIFO.
+//   USB:  TinyUSB CDC ACM device, tud_task() also runs from the poll.
+// A line that does not fit in the FIFO is dropped whole. The count of lines
+// dropped is sent as "[n dropped]" once there is room again, and is kept in
+// the stats.
+//
+// The sink is picked with FW_LOG_STREAM in CMake, USB also needs TinyUSB
+// linked in.
+
+#define LOGSTREAM_SINK_NONE (0)
+#define LOGSTREAM_SINK_UART (1)
+#define LOGSTREAM_SINK_USB  (2)
+
+#ifndef LOGSTREAM_SINK
+#define LOGSTREAM_SINK      LOGSTREAM_SINK_NONE
+#endif
+
+#define LOGSTREAM_UART      uart0
+#define LOGSTREAM_UART_TX   (28)
+#define LOGSTREAM_UART_BAUD (921600)
+#define LOGSTREAM_FIFO_SIZE (4096)  // Bytes, must be a power of 2
+
+typedef struct {
+    uint32_t lines;         // Lines queued
+    uint32_t bytes;         // Bytes handed to the sink
+    uint32_t dropped;       // Lines dropped on a full FIFO
+    uint32_t dropped_bytes;
+    uint32_t high_water;    // Most bytes ever waiting in the FIFO
+} logstream_stats_t;
+
+void logstream_init(void);
+void logstream_poll(void);
+void logstream_write(const char *text, int length);
+const logstream_stats_t *logstream_get_stats(void);
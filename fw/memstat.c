@@ -0,0 +1,94 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <stdint.h>
+#include <malloc.h>
+#include "pico/stdlib.h"
+#include "syslog.h"
+#include "memstat.h"
+
+// Leave this much below the live SP unpainted when painting our own stack
+#define MEMSTAT_PAINT_GUARD (64)
+
+// Linker symbols, see memmap_fw.ld
+extern uint32_t __StackTop;
+extern uint32_t __StackBottom;
+extern uint32_t __StackOneTop;
+extern uint32_t __StackOneBottom;
+extern uint32_t __scratch_x_end__;
+extern uint32_t __scratch_y_end__;
+extern char end;
+extern char __StackLimit;
+
+// Lowest address each stack can grow into before hitting other data. The
+// stacks only reserve PICO_STACK_SIZE, but the rest of the scratch bank is
+// free as well.
+static uint32_t *const stack_limit[2] = {&__scratch_y_end__, &__scratch_x_end__};
+static uint32_t *const stack_bottom[2] = {&__StackBottom, &__StackOneBottom};
+static uint32_t *const stack_top[2] = {&__StackTop, &__StackOneTop};
+
+static inline uint32_t *memstat_get_sp(void) {
+    uint32_t *sp;
+    __asm volatile ("mov %0, sp" : "=r" (sp));
+    return sp;
+}
+
+static void memstat_paint(uint32_t *from, uint32_t *to) {
+    while (from < to)
+        *from++ = MEMSTAT_STACK_PAINT;
+}
+
+static uint32_t memstat_stack_peak(int core) {
+    uint32_t *p = stack_limit[core];
+    while ((p < stack_top[core]) && (*p == MEMSTAT_STACK_PAINT))
+        p++;
+    return (uint32_t)(stack_top[core] - p) * 4;
+}
+
+// Must be called from core 0 before core 1 is launched
+void memstat_init(void) {
+    memstat_paint(stack_limit[0], memstat_get_sp() - MEMSTAT_PAINT_GUARD / 4);
+    memstat_paint(stack_limit[1], stack_top[1]);
+}
+
+void memstat_get(memstat_t *stat) {
+    for (int i = 0; i < 2; i++) {
+        stat->stack_size[i] = (uint32_t)(stack_top[i] - stack_bottom[i]) * 4;
+        stat->stack_free[i] = (uint32_t)(stack_top[i] - stack_limit[i]) * 4;
+        stat->stack_peak[i] = memstat_stack_peak(i);
+    }
+
+    struct mallinfo mi = mallinfo();
+    stat->heap_size = (uint32_t)(&__StackLimit - &end);
+    stat->heap_used = mi.uordblks;
+    stat->heap_peak = mi.arena;
+}
+
+void memstat_report(void) {
+    memstat_t stat;
+    memstat_get(&stat);
+    syslog_printf("Stack0 %d/%d (%d)", stat.stack_peak[0],
+            stat.stack_size[0], stat.stack_free[0]);
+    syslog_printf("Stack1 %d/%d (%d)", stat.stack_peak[1],
+            stat.stack_size[1], stat.stack_free[1]);
+    syslog_printf("Heap %d/%d peak %d", stat.heap_used, stat.heap_size,
+            stat.heap_peak);
+}
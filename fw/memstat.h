@@ -0,0 +1,41 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#pragma once
+
+#include <stdint.h>
+
+// Stacks are painted with this pattern at boot, the high-water mark is the
+// deepest word that no longer holds it.
+#define MEMSTAT_STACK_PAINT (0xa5a5a5a5u)
+
+typedef struct {
+    uint32_t stack_size[2];     // Reserved stack size per core
+    uint32_t stack_free[2];     // Usable space per core, reserved or not
+    uint32_t stack_peak[2];     // High-water mark per core
+    uint32_t heap_size;         // Space between end of bss and heap limit
+    uint32_t heap_used;         // Bytes in allocated chunks
+    uint32_t heap_peak;         // Bytes obtained from sbrk so far
+} memstat_t;
+
+void memstat_init(void);
+void memstat_get(memstat_t *stat);
+void memstat_report(void);
@@ -0,0 +1,137 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/irq.h"
+#include "hardware/timer.h"
+#include "prof.h"
+
+#ifdef PROF_ENABLE
+
+#define PROF_BUCKETS (PROF_TEXT_SIZE >> PROF_BUCKET_SHIFT)
+
+static uint16_t prof_hist[PROF_BUCKETS];
+static uint32_t prof_outside;   // Samples outside of the flash text
+static uint32_t prof_total;
+#ifdef PROF_RECORD_LR
+static uint32_t prof_raw[PROF_RAW_SAMPLES][2];
+static uint32_t prof_raw_wr;
+#endif
+
+static int prof_alarm = -1;
+static uint32_t prof_period;
+
+// Called with the hardware exception frame: r0-r3, r12, lr, pc, xpsr
+void __not_in_flash_func(prof_sample)(uint32_t *frame) {
+    timer_hw->intr = 1u << prof_alarm;
+    timer_hw->alarm[prof_alarm] = timer_hw->timerawl + prof_period;
+
+    uint32_t pc = frame[6];
+    uint32_t offset = pc - PROF_TEXT_BASE;
+    if (offset < PROF_TEXT_SIZE) {
+        uint16_t *bucket = &prof_hist[offset >> PROF_BUCKET_SHIFT];
+        if (*bucket != UINT16_MAX)
+            (*bucket)++;
+    }
+    else {
+        prof_outside++;
+    }
+    prof_total++;
+#ifdef PROF_RECORD_LR
+    prof_raw[prof_raw_wr][0] = pc;
+    prof_raw[prof_raw_wr][1] = frame[5];
+    prof_raw_wr = (prof_raw_wr + 1) % PROF_RAW_SAMPLES;
+#endif
+}
+
+// There is no RTOS, everything runs on MSP, so the stacked frame sits right at
+// SP on entry. Tail-call into C with it, keeping EXC_RETURN in LR.
+static void __attribute__((naked)) prof_isr(void) {
+    __asm volatile (
+        "mov r0, sp\n"
+        "ldr r1, =prof_sample\n"
+        "bx r1\n"
+    );
+}
+
+void prof_start(uint32_t rate_hz) {
+    if (prof_alarm < 0) {
+        prof_alarm = hardware_alarm_claim_unused(true);
+        uint irq = TIMER_IRQ_0 + prof_alarm;
+        irq_set_exclusive_handler(irq, prof_isr);
+        // Above everything else so ISRs get sampled as well
+        irq_set_priority(irq, PICO_HIGHEST_IRQ_PRIORITY);
+        irq_set_enabled(irq, true);
+    }
+    prof_period = 1000000 / (rate_hz ? rate_hz : PROF_DEFAULT_RATE);
+    timer_hw->alarm[prof_alarm] = timer_hw->timerawl + prof_period;
+    hw_set_bits(&timer_hw->inte, 1u << prof_alarm);
+}
+
+void prof_stop(void) {
+    if (prof_alarm < 0)
+        return;
+    hw_clear_bits(&timer_hw->inte, 1u << prof_alarm);
+    timer_hw->armed = 1u << prof_alarm;
+}
+
+void prof_reset(void) {
+    uint32_t save = save_and_disable_interrupts();
+    memset(prof_hist, 0, sizeof(prof_hist));
+    prof_outside = 0;
+    prof_total = 0;
+#ifdef PROF_RECORD_LR
+    memset(prof_raw, 0, sizeof(prof_raw));
+    prof_raw_wr = 0;
+#endif
+    restore_interrupts(save);
+}
+
+// Text dump for tools/profsym.py, one record per line:
+//   T <total> <outside> <bucket shift>
+//   P <bucket address> <count>
+//   S <pc> <lr>
+void prof_dump(void) {
+    printf("T %lu %lu %d\n", prof_total, prof_outside, PROF_BUCKET_SHIFT);
+    for (int i = 0; i < PROF_BUCKETS; i++) {
+        if (prof_hist[i])
+            printf("P %08x %u\n", PROF_TEXT_BASE + (i << PROF_BUCKET_SHIFT),
+                    prof_hist[i]);
+    }
+#ifdef PROF_RECORD_LR
+    for (int i = 0; i < PROF_RAW_SAMPLES; i++) {
+        if (prof_raw[i][0])
+            printf("S %08lx %08lx\n", prof_raw[i][0], prof_raw[i][1]);
+    }
+#endif
+}
+
+#else
+
+void prof_start(uint32_t rate_hz) { }
+void prof_stop(void) { }
+void prof_reset(void) { }
+void prof_dump(void) { }
+
+#endif
@@ -0,0 +1,45 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#pragma once
+
+#include <stdint.h>
+
+// Timer driven sampling profiler. Each sample records the interrupted PC into
+// a histogram over the flash text, and optionally the PC/LR pair into a raw
+// ring for call graph reconstruction. Use tools/profsym.py to symbolize the
+// output of prof_dump() against the ELF. The dump goes to stdio, so enable a
+// stdio channel in CMakeLists.txt when using this.
+
+//#define PROF_ENABLE
+//#define PROF_RECORD_LR
+
+#define PROF_DEFAULT_RATE       (1000)  // Hz
+#define PROF_TEXT_BASE          (0x10000000)
+#define PROF_TEXT_SIZE          (128 * 1024)
+#define PROF_BUCKET_SHIFT       (4)     // 16 bytes per histogram bucket
+#define PROF_RAW_SAMPLES        (1024)
+#define PROF_DUMP_INTERVAL_MS   (10000) // Dump and restart, 0 to disable
+
+void prof_start(uint32_t rate_hz);
+void prof_stop(void);
+void prof_reset(void);
+void prof_dump(void);
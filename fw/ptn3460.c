@@ -74,7 +74,7 @@ void ptn3460_init() {
         }
         sleep_ms(1);
     }
-    syslog_printf("PTN3460 up after %d ms", ticks);
+    SYSLOG(PTN3460, SYSLOG_INFO, "PTN3460 up after %d ms", ticks);
     // Enable EDID emulation
     ptn3460_select_edid_emulation(0);
     //ptn3460_load_edid();
@@ -88,4 +88,10 @@ void ptn3460_init() {
     if (result != 2) {
         fatal("Failed writing data to PTN3460");
     }
-}
\ No newline at end of file
+}
+
+// The PTN3460 holds HPD high while it is powered up and ready for the DP
+// link training
+bool ptn3460_is_up(void) {
+    return gpio_get(PTN3460_HPD_PIN);
+}
@@ -21,4 +21,7 @@
 //
 #pragma once
 
-void ptn3460_init();
\ No newline at end of file
+#include <stdbool.h>
+
+void ptn3460_init();
+bool ptn3460_is_up(void);
\ No newline at end of file
@@ -20,105 +20,422 @@
 // SOFTWARE.
 //
 #include "pico/stdlib.h"
-#include <stdio.h>
+#include "hardware/sync.h"
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <limits.h>
 #include "lcd.h"
 #include "ui.h"
 #include "syslog.h"
+#include "trace.h"
+#include "logstream.h"
+#include "flashlog.h"
+#include "fmt.h"
 
-typedef struct _msg_t {
-    struct _msg_t *prev;
-    struct _msg_t *next;
+// Messages are variable length records in a fixed byte ring, the oldest
+// ones make room for new ones. A record never wraps around the end of the
+// arena: if it does not fit there, the ring continues from the start and
+// the tail end is left unused until the head gets past it.
+//
+// Layout is worked out once when a message is added. The font is fixed
+// width, so wrapped line k of a message starts at byte k * SYSLOG_LINE_CHARS
+// and only the count needs keeping.
+typedef struct {
+    uint16_t size;      // Record size, header included
+    uint16_t prev;      // Arena offset of the previous record
+    int line;           // Number of the first wrapped line
+    uint16_t len;       // strlen(text)
+    uint8_t lines;      // Wrapped lines
     char text[];
 } msg_t;
 
+#if SYSLOG_ARENA_SIZE > 65536
+#error "Record offsets are 16-bit"
+#endif
+
+// The log area below the title is a ring of 8-pixel line slots shown
+// through ui_set_scroll(). Wrapped lines are numbered from the first one ever
+// logged, line n lives in slot n % SYSLOG_SLOTS, so scrolling only moves the
+// ring and draws the lines that came into view.
+#define SYSLOG_BAND_Y (8)
+#define SYSLOG_SLOTS ((UI_HEIGHT - SYSLOG_BAND_Y) / 8)
+#define SYSLOG_BAND_H (SYSLOG_SLOTS * 8)
+#define SYSLOG_LINE_CHARS (UI_WIDTH / 6)
+// Pixels per frame when scrolling, the cell UI can only do whole lines
+#ifdef LCD_LINE_MODE
+#define SYSLOG_SCROLL_STEP (8)
+#else
+#define SYSLOG_SCROLL_STEP (1)
+#endif
+#define SYSLOG_SLOT_INVALID (INT_MIN)
+
 // States
+static uint8_t arena[SYSLOG_ARENA_SIZE] __attribute__((aligned(4)));
 static msg_t *head;
 static msg_t *tail;
-static msg_t *viewable_first;
-static int offset;
+// Offset the next record goes at
+static uint32_t wr;
+// Set when wr has gone back to the start of the arena, records then run from
+// head to wrap_end, then from 0 to wr
+static bool wrapped;
+static uint32_t wrap_end;
+// Last message drawn from, lines on screen are looked up next to it
+static msg_t *cursor;
 static int count;
+// Wrapped line numbers of the oldest message and past the newest
+static int first_line;
+static int end_line;
+// Pixels scrolled back from the newest line, and where it is heading
+static int view;
+static int view_target;
+// Slot contents on screen: line number and the row the next line starts at
+// if the slot is shared by the top and bottom lines
+static int slot_line[SYSLOG_SLOTS];
+static int slot_split[SYSLOG_SLOTS];
+static bool drawn;
+// A redraw was cut short by the UI time slice, the view holds still until
+// it is finished
+static bool partial;
 
 static bool dirty;
 
 void syslog_init(void) {
     head = NULL;
     tail = NULL;
+    wr = 0;
+    wrapped = false;
+    cursor = NULL;
     count = 0;
+    first_line = 0;
+    end_line = 0;
+    view = 0;
+    view_target = 0;
+    drawn = false;
+    partial = false;
+    lcd_hold(false);
     dirty = true;
 }
 
+static int syslog_mod(int a, int m) {
+    int r = a % m;
+    return (r < 0) ? (r + m) : r;
+}
+
+static msg_t *syslog_msg_at(uint32_t offset) {
+    return (msg_t *)&arena[offset];
+}
+
+static uint32_t syslog_offset(const msg_t *msg) {
+    return (const uint8_t *)msg - arena;
+}
+
+// Record after msg, which must not be the tail
+static msg_t *syslog_next(const msg_t *msg) {
+    uint32_t offset = syslog_offset(msg) + msg->size;
+    if (wrapped && (offset == wrap_end))
+        offset = 0;
+    return syslog_msg_at(offset);
+}
+
+static int syslog_max_view(void) {
+    int h = (end_line - first_line) * 8 - SYSLOG_BAND_H;
+    return (h > 0) ? h : 0;
+}
+
+// Draw wrapped line n with its top at row y, blank if there is no such line
+static void syslog_draw_line(int n, int y) {
+    char buf[SYSLOG_LINE_CHARS + 1];
+
+    if ((n < first_line) || (n >= end_line))
+        return;
+    // Visible lines are next to each other, this is a step or two at most
+    msg_t *msg = cursor ? cursor : tail;
+    while (n < msg->line)
+        msg = syslog_msg_at(msg->prev);
+    while (n >= msg->line + msg->lines)
+        msg = syslog_next(msg);
+    cursor = msg;
+
+    int offset = (n - msg->line) * SYSLOG_LINE_CHARS;
+    int len = msg->len - offset;
+    if (len > SYSLOG_LINE_CHARS)
+        len = SYSLOG_LINE_CHARS;
+    memcpy(buf, msg->text + offset, len);
+    buf[len] = '\0';
+    ui_disp_string(0, y, buf, 0xffff);
+}
+
+// Bring a slot up to date. A split slot shows the top rows of the line
+// below the view above the bottom rows of line n.
+// Returns false if the slot already shows the line
+static bool syslog_draw_slot(int slot, int n, int split) {
+    if ((slot_line[slot] == n) && (slot_split[slot] == split))
+        return false;
+    int y = SYSLOG_BAND_Y + slot * 8;
+    ui_set_clip(y, 8);
+    ui_disp_fill(0, y, UI_WIDTH - 1, y + 7, 0x0000);
+    if (split) {
+        ui_set_clip(y, split);
+        syslog_draw_line(n + SYSLOG_SLOTS, y);
+        ui_set_clip(y + split, 8 - split);
+    }
+    syslog_draw_line(n, y);
+    ui_set_clip(0, 0);
+    slot_line[slot] = n;
+    slot_split[slot] = split;
+    return true;
+}
+
 void syslog_disp(void) {
+    syslog_flush();
     if (!dirty)
         return;
-    ui_clear(0x0000);
-    ui_disp_string(0, 0, "System log", 0xffff);
-    
-    msg_t *msg = viewable_first;
-    int y = UI_HEIGHT;
-    while ((msg) && (y > 8)) {
-        int h = ui_disp_string_bb(msg->text, UI_WIDTH);
-        y -= h;
-        if (y >= 8)
-            ui_disp_string(0, y, msg->text, 0xffff);
-        msg = msg->prev;
+    if (!drawn) {
+        ui_clear(0x0000);
+        ui_disp_string(0, 0, "System log", 0xffff);
+        for (int i = 0; i < SYSLOG_SLOTS; i++)
+            slot_line[i] = SYSLOG_SLOT_INVALID;
+        drawn = true;
     }
-    lcd_update();
-    dirty = false;
-}
 
-static void syslog_add_to_tail(msg_t *msg) {
-    msg->prev = tail;
-    if (tail) {
-        tail->next = msg;
+    // One step per frame, so that scrolling is seen to move
+    if ((view != view_target) && !partial && !lcd_is_busy()) {
+        int step = view_target - view;
+        if (step > SYSLOG_SCROLL_STEP) step = SYSLOG_SCROLL_STEP;
+        if (step < -SYSLOG_SCROLL_STEP) step = -SYSLOG_SCROLL_STEP;
+        view += step;
     }
-    else {
-        head = msg;
+
+    // Pixel row of the wrapped lines at the top of the view, lines before
+    // the first one are blank so a short log sits at the bottom
+    int top = end_line * 8 - view - SYSLOG_BAND_H;
+    int split = syslog_mod(top, 8);
+    int n0 = (top - split) / 8;
+    // A line per chunk. Slots that are done are skipped when this resumes.
+    partial = true;
+    for (int n = n0; n < n0 + SYSLOG_SLOTS; n++) {
+        if (syslog_draw_slot(syslog_mod(n, SYSLOG_SLOTS), n,
+                (n == n0) ? split : 0) && ui_slice_done()) {
+            // The slots drawn so far are only in the back buffer
+            lcd_hold(true);
+            return;
+        }
     }
-    tail = msg;
-    viewable_first = msg;
-    count++;
+    partial = false;
+    lcd_hold(false);
+    ui_set_scroll(SYSLOG_BAND_Y, SYSLOG_BAND_H,
+            syslog_mod(top, SYSLOG_BAND_H));
+    ui_update();
+    dirty = (view != view_target);
+}
+
+// Scroll the view back by px pixels, or towards the newest line if negative.
+// The view moves there gradually over the next syslog_disp() calls.
+void syslog_scroll(int px) {
+    view_target += px;
+    if (view_target < 0)
+        view_target = 0;
+    if (view_target > syslog_max_view())
+        view_target = syslog_max_view();
+    dirty = true;
 }
 
 static void syslog_del_from_head(void) {
     msg_t *old = head;
-    if (head) {
-        head = head->next;
-        if (head)
-            head->prev = NULL;
-        free(old);
-        count--;
+    if (!count)
+        return;
+
+    first_line += old->lines;
+    if (cursor == old)
+        cursor = NULL;
+    count--;
+    if (count) {
+        head = syslog_next(old);
+        if (syslog_offset(head) == 0)
+            wrapped = false;
     }
+    else {
+        // Empty, start over from the beginning
+        head = NULL;
+        tail = NULL;
+        wr = 0;
+        wrapped = false;
+    }
+
+    // Lines shown from it are gone
+    for (int i = 0; i < SYSLOG_SLOTS; i++)
+        if (slot_line[i] < first_line)
+            slot_line[i] = SYSLOG_SLOT_INVALID;
+    if (view > syslog_max_view())
+        view = syslog_max_view();
+    if (view_target > syslog_max_view())
+        view_target = syslog_max_view();
 }
 
-int syslog_printf(const char *format, ...) {
-    char time_buffer[24];
-    char printf_buffer[SYSLOG_PRINTF_BUFFER_SIZE];
+// Make room for a record of size bytes at wr, dropping the oldest messages
+// as needed. Each step either drops one message or wraps once, so this is
+// bounded by the number of messages that fit in size bytes.
+static msg_t *syslog_alloc(uint32_t size) {
+    while (1) {
+        if (!wrapped) {
+            if (wr + size <= SYSLOG_ARENA_SIZE)
+                break;
+            // No room left at the end, carry on from the start
+            wrap_end = wr;
+            wr = 0;
+            wrapped = (count != 0);
+        }
+        else {
+            if (wr + size <= syslog_offset(head))
+                break;
+            syslog_del_from_head();
+        }
+    }
+    return syslog_msg_at(wr);
+}
 
-    uint64_t time = get_absolute_time();
-    int time_length = snprintf(time_buffer, 24, "[%d]", (uint32_t)time / 1000);
+static void syslog_add_to_tail(msg_t *msg) {
+    msg->prev = tail ? syslog_offset(tail) : 0;
+    if (!count)
+        head = msg;
+    tail = msg;
+    wr += msg->size;
+    count++;
 
-    int length = 0;
+    // Same wrapping as ui_disp_string()
+    int lines = msg->len / SYSLOG_LINE_CHARS + 1;
+    msg->line = end_line;
+    msg->lines = lines;
+    end_line += lines;
+    // Keep a scrolled back view where it is
+    if (view_target) {
+        view += lines * 8;
+        view_target += lines * 8;
+    }
+}
 
-    va_list ap;
-    va_start(ap, format);
+// Messages are formatted straight into the arena: syslog_begin() makes room
+// for the longest one, syslog_end() trims the record to what was written.
+typedef struct {
+    msg_t *msg;
+    uint32_t time;          // us
+    int text;               // Offset of the message after the timestamp
+} syslog_out_t;
 
-    length = vsnprintf(printf_buffer, SYSLOG_PRINTF_BUFFER_SIZE, format, ap);
+#define SYSLOG_TIME_CHARS (9)   // "[4294967]"
+#define SYSLOG_MAX_SIZE ((sizeof(msg_t) + SYSLOG_TIME_CHARS + \
+        SYSLOG_PRINTF_BUFFER_SIZE + 3) & ~3u)
 
-    va_end(ap);
+static void syslog_put(void *ctx, char c) {
+    syslog_out_t *out = ctx;
+    if (out->msg->len < out->text + SYSLOG_PRINTF_BUFFER_SIZE - 1)
+        out->msg->text[out->msg->len++] = c;
+}
+
+// Start a message logged at time (in us)
+static void syslog_begin(syslog_out_t *out, uint32_t time) {
+    out->msg = syslog_alloc(SYSLOG_MAX_SIZE);
+    out->time = time;
+    out->msg->len = 0;
+    // Bounds the timestamp until the message proper starts
+    out->text = 0;
+    fmt_format_words(syslog_put, out, "[%u]", &(uint32_t){time / 1000}, 1);
+    out->text = out->msg->len;
+}
+
+static void syslog_end(syslog_out_t *out) {
+    msg_t *msg = out->msg;
+    int length = msg->len - out->text;
 
-    msg_t *msg = malloc(sizeof(msg_t) + time_length + length + 1);
-    memcpy(msg->text, time_buffer, time_length);
-    memcpy(msg->text + time_length, printf_buffer, length + 1);
-    msg->next = NULL;
-    msg->prev = NULL;
+    TRACE(TRACE_SYSLOG, length);
 
-    if (count >= SYSLOG_MAX_LINES)
-        syslog_del_from_head();
+    msg->text[msg->len] = '\0';
+    msg->size = (sizeof(msg_t) + msg->len + 1 + 3) & ~3u;
     syslog_add_to_tail(msg);
     dirty = true;
+    logstream_write(msg->text, msg->len);
+#ifdef FLASHLOG_TEXT
+    flashlog_write(FLASHLOG_TEXT_LINE, out->time, msg->text + out->text,
+            length);
+#endif
+}
+
+int syslog_printf(const char *format, ...) {
+    syslog_out_t out;
+    va_list ap;
+
+    syslog_begin(&out, time_us_32());
+    va_start(ap, format);
+    int length = fmt_vformat(syslog_put, &out, format, ap);
+    va_end(ap);
+    syslog_end(&out);
 
     return length;
-}
\ No newline at end of file
+}
+
+// Runtime level mask per module, bit n enables level n. Everything that is
+// compiled in starts enabled.
+uint8_t syslog_mask[SYSLOG_MOD_COUNT] = {
+    [0 ... SYSLOG_MOD_COUNT - 1] = 0xff
+};
+
+void syslog_set_mask(syslog_mod_t mod, uint8_t mask) {
+    syslog_mask[mod] = mask;
+}
+
+#ifdef SYSLOG_DEFERRED
+static syslog_rec_t syslog_rec_ring[SYSLOG_REC_RING_SIZE];
+static volatile uint32_t syslog_rec_wr;
+static uint32_t syslog_rec_rd;
+static uint32_t syslog_rec_drop;
+
+void __not_in_flash_func(syslog_defer)(const char *fmt, uint32_t argc,
+        const uint32_t *args) {
+    uint32_t save = save_and_disable_interrupts();
+    uint32_t wr = syslog_rec_wr;
+    if ((wr - syslog_rec_rd) >= SYSLOG_REC_RING_SIZE) {
+        syslog_rec_drop++;
+        restore_interrupts(save);
+        return;
+    }
+    syslog_rec_t *rec = &syslog_rec_ring[wr & (SYSLOG_REC_RING_SIZE - 1)];
+    rec->time = timer_hw->timerawl;
+    rec->fmt = fmt;
+    rec->argc = argc;
+    for (uint32_t i = 0; i < argc; i++)
+        rec->args[i] = args[i];
+    syslog_rec_wr = wr + 1;
+    restore_interrupts(save);
+}
+
+// Format the records logged since the last call into the log
+void syslog_flush(void) {
+    syslog_out_t out;
+
+    // A record per chunk, the rest wait for the next call once the UI time
+    // slice is used up
+    while (syslog_rec_rd != syslog_rec_wr) {
+        const syslog_rec_t *rec =
+                &syslog_rec_ring[syslog_rec_rd & (SYSLOG_REC_RING_SIZE - 1)];
+        syslog_begin(&out, rec->time);
+        fmt_format_words(syslog_put, &out, rec->fmt, rec->args, rec->argc);
+        syslog_end(&out);
+        syslog_rec_rd++;
+        if (ui_slice_done())
+            return;
+    }
+    if (syslog_rec_drop) {
+        uint32_t save = save_and_disable_interrupts();
+        uint32_t drop = syslog_rec_drop;
+        syslog_rec_drop = 0;
+        restore_interrupts(save);
+        syslog_begin(&out, time_us_32());
+        fmt_format_words(syslog_put, &out, "%u dropped", &drop, 1);
+        syslog_end(&out);
+    }
+}
+#else
+void syslog_flush(void) {
+}
+#endif
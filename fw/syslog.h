@@ -21,9 +21,123 @@
 //
 #pragma once
 
-#define SYSLOG_MAX_LINES (100)
+#include <stdint.h>
+#include <stddef.h>
+
+// Bytes kept for messages, the oldest ones are dropped to make room
+#define SYSLOG_ARENA_SIZE (4096)
 #define SYSLOG_PRINTF_BUFFER_SIZE 128
 
+// Log levels. A message is compiled in if its level is at most
+// SYSLOG_LEVEL_<module>, and shown if its bit is set in the module's runtime
+// mask. Messages above the compile-time level cost nothing at all.
+#define SYSLOG_ERR      0
+#define SYSLOG_WARN     1
+#define SYSLOG_INFO     2
+#define SYSLOG_DEBUG    3
+
+typedef enum {
+    SYSLOG_MOD_PD = 0,      // PD protocol state machine
+    SYSLOG_MOD_POLICY,      // PD policy, alternate modes
+    SYSLOG_MOD_TCPC,
+    SYSLOG_MOD_PTN3460,
+    SYSLOG_MOD_UI,          // LCD and UI, benchmarks
+    SYSLOG_MOD_COUNT
+} syslog_mod_t;
+
+#ifndef SYSLOG_LEVEL_PD
+#define SYSLOG_LEVEL_PD         SYSLOG_INFO
+#endif
+#ifndef SYSLOG_LEVEL_POLICY
+#define SYSLOG_LEVEL_POLICY     SYSLOG_INFO
+#endif
+#ifndef SYSLOG_LEVEL_TCPC
+#define SYSLOG_LEVEL_TCPC       SYSLOG_INFO
+#endif
+#ifndef SYSLOG_LEVEL_PTN3460
+#define SYSLOG_LEVEL_PTN3460    SYSLOG_INFO
+#endif
+#ifndef SYSLOG_LEVEL_UI
+#define SYSLOG_LEVEL_UI         SYSLOG_INFO
+#endif
+
+// Deferred formatting for the PD hot paths. SYSLOG() messages only
+// store the timestamp, the format string address and up to
+// SYSLOG_REC_MAX_ARGS raw 32-bit argument words into a ring, a few tens of
+// cycles. syslog_flush(), called from syslog_disp(), formats them into the
+// log later. Records are dropped (and counted) when the ring is full.
+//
+// Format strings go into the .syslog_fmt section. The build extracts it from
+// the ELF into fw.logstr, which tools/logdecode.py uses to turn a raw record
+// dump back into text on the host. The string address is the record's
+// format ID.
+//
+// Arguments must be 32-bit integers or pointers. %s arguments are read when
+// the record is formatted, so they have to point to constant strings.
+// Without SYSLOG_DEFERRED, messages go through syslog_printf().
+#define SYSLOG_DEFERRED
+#define SYSLOG_REC_RING_SIZE (64)   // Records, must be a power of 2
+#define SYSLOG_REC_MAX_ARGS (5)
+
+typedef struct {
+    uint32_t time;          // us
+    const char *fmt;
+    uint32_t argc;
+    uint32_t args[SYSLOG_REC_MAX_ARGS];
+} syslog_rec_t;
+
 void syslog_init(void);
 void syslog_disp(void);
+void syslog_scroll(int px);
 int syslog_printf(const char *format, ...) __attribute__((format(gnu_printf, 1, 2)));
+void syslog_flush(void);
+
+void syslog_set_mask(syslog_mod_t mod, uint8_t mask);
+extern uint8_t syslog_mask[SYSLOG_MOD_COUNT];
+
+#define SYSLOG_STR(x) SYSLOG_STR_(x)
+#define SYSLOG_STR_(x) #x
+// "<module>:<level>:" in front of the format strings in the ELF, for the
+// build report. It is not part of the format. The level is stringized, so it
+// has to be one of the SYSLOG_<level> constants, not an expression.
+#define SYSLOG_TAG(mod, level) #mod ":" SYSLOG_STR(level) ":"
+
+// Every call site, compiled in or not, leaves its tagged format string in
+// .syslog_sites. The linker script keeps that section out of the image, it
+// only tells tools/logstrings.py what the levels that are off would cost.
+#define SYSLOG(mod, level, format, ...) do { \
+    static const char syslog_site_[] \
+            __attribute__((used, section(".syslog_sites"))) = \
+            SYSLOG_TAG(mod, level) format; \
+    if (((level) <= SYSLOG_LEVEL_ ## mod) && \
+            (syslog_mask[SYSLOG_MOD_ ## mod] & (1u << (level)))) \
+        SYSLOG_DEFER(SYSLOG_TAG(mod, level), format, ## __VA_ARGS__); \
+} while (0)
+
+#ifdef SYSLOG_DEFERRED
+void syslog_defer(const char *fmt, uint32_t argc, const uint32_t *args);
+
+#define SYSLOG_NARG(...) SYSLOG_NARG_(0, ## __VA_ARGS__, 5, 4, 3, 2, 1, 0)
+#define SYSLOG_NARG_(_0, _1, _2, _3, _4, _5, n, ...) n
+#define SYSLOG_W(a) ((uint32_t)(uintptr_t)(a))
+#define SYSLOG_ARGS_0()
+#define SYSLOG_ARGS_1(a) SYSLOG_W(a)
+#define SYSLOG_ARGS_2(a, ...) SYSLOG_W(a), SYSLOG_ARGS_1(__VA_ARGS__)
+#define SYSLOG_ARGS_3(a, ...) SYSLOG_W(a), SYSLOG_ARGS_2(__VA_ARGS__)
+#define SYSLOG_ARGS_4(a, ...) SYSLOG_W(a), SYSLOG_ARGS_3(__VA_ARGS__)
+#define SYSLOG_ARGS_5(a, ...) SYSLOG_W(a), SYSLOG_ARGS_4(__VA_ARGS__)
+#define SYSLOG_CAT(a, b) SYSLOG_CAT_(a, b)
+#define SYSLOG_CAT_(a, b) a ## b
+
+// The record points past the tag
+#define SYSLOG_DEFER(tag, format, ...) do { \
+    static const char syslog_fmt_[] \
+            __attribute__((section(".syslog_fmt"))) = tag format; \
+    const uint32_t syslog_args_[] = {0, \
+            SYSLOG_CAT(SYSLOG_ARGS_, SYSLOG_NARG(__VA_ARGS__))(__VA_ARGS__)}; \
+    syslog_defer(syslog_fmt_ + sizeof(tag) - 1, SYSLOG_NARG(__VA_ARGS__), \
+            &syslog_args_[1]); \
+} while (0)
+#else
+#define SYSLOG_DEFER(tag, format, ...) syslog_printf(format, ## __VA_ARGS__)
+#endif
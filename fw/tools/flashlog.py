@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+#
+# Copyright 2021 Wenting Zhang <zephray@outlook.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+#
+# Print the persistent log kept in flash by flashlog.c, oldest page first.
+#
+# Usage: flashlog.py log.bin
+#
+# log.bin is the log region read back from the board, for example with
+#   picotool save -r 0x10fc0000 0x11000000 log.bin
+# (FLASHLOG_OFFSET and FLASHLOG_SIZE in flashlog.h).
+
+import struct
+import sys
+
+PAGE_SIZE = 256
+MAGIC = 0x474f4c50
+
+PAGE_FORMAT = "<IIII"
+ENTRY_FORMAT = "<BBHI"
+PAGE_HDR = struct.calcsize(PAGE_FORMAT)
+ENTRY_HDR = struct.calcsize(ENTRY_FORMAT)
+
+BOOT, TEXT, CRASH, END = 0, 1, 2, 0xff
+CRASH_TRACE = 12
+REASON_SIZE = 64
+
+
+def entries(page):
+    pos = PAGE_HDR
+    while pos + ENTRY_HDR <= PAGE_SIZE:
+        kind, length, _, time = struct.unpack_from(ENTRY_FORMAT, page, pos)
+        if kind == END:
+            break
+        pos += ENTRY_HDR
+        yield kind, time, page[pos:pos + length]
+        pos += (length + 3) & ~3
+
+
+def format_entry(kind, payload):
+    if kind == TEXT:
+        return payload.decode("ascii", "replace")
+    if kind == BOOT:
+        fields = struct.unpack_from("<I8I", payload)
+        return "boot%s, scratch %s" % (
+            " (watchdog)" if fields[0] else "",
+            " ".join("%08x" % s for s in fields[1:]))
+    if kind == CRASH:
+        scratch = struct.unpack_from("<8I", payload)
+        flags, state, polarity, vdm, count = struct.unpack_from(
+            "<IBBBB", payload, 32)
+        lines = ["CRASH: %s" % payload[40 + 8 * CRASH_TRACE:][:REASON_SIZE]
+                 .split(b"\0")[0].decode("ascii", "replace"),
+                 "  PD state %d, flags %08x, polarity %d, VDM busy %d" % (
+                     state, flags, polarity, vdm),
+                 "  scratch %s" % " ".join("%08x" % s for s in scratch)]
+        for i in range(min(count, CRASH_TRACE)):
+            time, event, _, arg = struct.unpack_from("<IBBH", payload,
+                                                     40 + 8 * i)
+            lines.append("  trace %10d us  id %2d  arg %04x" % (
+                time, event, arg))
+        return "\n".join(lines)
+    return "<type %d, %d bytes>" % (kind, len(payload))
+
+
+def main():
+    if len(sys.argv) != 2:
+        print("Usage: %s log.bin" % sys.argv[0], file=sys.stderr)
+        return 1
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+    pages = []
+    for pos in range(0, len(data) - PAGE_SIZE + 1, PAGE_SIZE):
+        magic, seq, boot, _ = struct.unpack_from(PAGE_FORMAT, data, pos)
+        if magic == MAGIC:
+            pages.append((seq, boot, data[pos:pos + PAGE_SIZE]))
+    pages.sort()
+    last_boot = None
+    for seq, boot, page in pages:
+        if boot != last_boot:
+            print("--- boot %d ---" % boot)
+            last_boot = boot
+        for kind, time, payload in entries(page):
+            print("[%d]%s" % (time // 1000, format_entry(kind, payload)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+#
+# Copyright 2021 Wenting Zhang <zephray@outlook.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# Convert the 5x7 column-major font in font.h to framebuffer row masks.
+#
+# Usage: fontgen.py font.h font_lcd.h
+#
+# font.h stores one byte per glyph column, bit n being row n. The output has
+# one mask per framebuffer row the glyph covers, bit n being the nth pixel of
+# that row's span, for both UI orientations:
+#   ROTATE_UI: 5 rows (one per glyph column) of 7 pixels, glyph row 6 first
+#   otherwise: 7 rows (one per glyph row) of 5 pixels, glyph column 0 first
+
+import re
+import sys
+
+GLYPH_W = 5
+GLYPH_H = 7
+FIRST_CHAR = 0x20
+
+
+def load(path):
+    with open(path) as f:
+        text = f.read()
+    body = text[text.index('{') + 1:text.rindex('}')]
+    data = [int(v, 16) for v in re.findall(r'0[xX]([0-9a-fA-F]{2})', body)]
+    if len(data) % GLYPH_W:
+        sys.exit('%s: %d bytes is not a whole number of glyphs' % (path, len(data)))
+    return [data[i:i + GLYPH_W] for i in range(0, len(data), GLYPH_W)]
+
+
+def rotated(cols):
+    rows = []
+    for col in cols:
+        mask = 0
+        for k in range(GLYPH_H):
+            if (col >> (GLYPH_H - 1 - k)) & 1:
+                mask |= 1 << k
+        rows.append(mask)
+    return rows
+
+
+def upright(cols):
+    rows = []
+    for y in range(GLYPH_H):
+        mask = 0
+        for x, col in enumerate(cols):
+            if (col >> y) & 1:
+                mask |= 1 << x
+        rows.append(mask)
+    return rows
+
+
+def table(glyphs, conv, nrows):
+    out = ['static const uint8_t font_lcd[][%d] = {' % nrows]
+    for i, cols in enumerate(glyphs):
+        rows = ', '.join('0x%02X' % r for r in conv(cols))
+        out.append('    {%s}, // 0x%02X' % (rows, FIRST_CHAR + i))
+    out.append('};')
+    return out
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: fontgen.py font.h font_lcd.h')
+    glyphs = load(sys.argv[1])
+    out = [
+        '// Generated by tools/fontgen.py from font.h, do not edit',
+        '#pragma once',
+        '',
+        '#include <stdint.h>',
+        '',
+        '#define FONT_LCD_FIRST (0x%02X)' % FIRST_CHAR,
+        '#define FONT_LCD_GLYPHS (%d)' % len(glyphs),
+        '',
+        '#ifdef ROTATE_UI',
+        '#define FONT_LCD_ROWS (%d)' % GLYPH_W,
+        '#define FONT_LCD_SPAN (%d)' % GLYPH_H,
+    ]
+    out += table(glyphs, rotated, GLYPH_W)
+    out += [
+        '#else',
+        '#define FONT_LCD_ROWS (%d)' % GLYPH_H,
+        '#define FONT_LCD_SPAN (%d)' % GLYPH_W,
+    ]
+    out += table(glyphs, upright, GLYPH_H)
+    out += ['#endif', '']
+    with open(sys.argv[2], 'w') as f:
+        f.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+#
+# Copyright 2021 Wenting Zhang <zephray@outlook.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# Turn a dump of deferred syslog records back into text.
+#
+# Usage: logdecode.py fw.logstr records.bin
+#
+# records.bin holds syslog_rec_t records as laid out in syslog.h, for example
+# syslog_rec_ring saved from a debugger. Format strings and %s arguments are
+# looked up in the table written by logstrings.py at build time.
+
+import ast
+import re
+import struct
+import sys
+
+REC_FORMAT = "<III5I"
+REC_SIZE = struct.calcsize(REC_FORMAT)
+
+CONVERSION = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|z|t)?([diuxXcsp%])")
+
+
+def load_table(path):
+    table = {}
+    with open(path) as f:
+        for line in f:
+            addr, literal = line.rstrip("\n").split("\t", 1)
+            table[int(addr, 16)] = ast.literal_eval(literal)
+    return table
+
+
+def format_record(table, fmt_addr, args):
+    fmt = table.get(fmt_addr)
+    if fmt is None:
+        return "<unknown format %08x> %s" % (
+            fmt_addr, " ".join("%08x" % a for a in args))
+    args = list(args)
+
+    def convert(m):
+        flags, kind = m.groups()
+        if kind == "%":
+            return "%"
+        value = args.pop(0) if args else 0
+        if kind == "s":
+            return ("%" + flags + "s") % table.get(value, "<%08x>" % value)
+        if kind == "c":
+            return chr(value & 0xff)
+        if kind == "p":
+            return "0x%08x" % value
+        if kind in "di" and value & 0x80000000:
+            value -= 1 << 32
+        return ("%" + flags + kind.replace("u", "d")) % value
+
+    return CONVERSION.sub(convert, fmt)
+
+
+def main():
+    if len(sys.argv) != 3:
+        print("Usage: %s fw.logstr records.bin" % sys.argv[0],
+              file=sys.stderr)
+        return 1
+    table = load_table(sys.argv[1])
+    with open(sys.argv[2], "rb") as f:
+        data = f.read()
+    records = []
+    for pos in range(0, len(data) - REC_SIZE + 1, REC_SIZE):
+        fields = struct.unpack_from(REC_FORMAT, data, pos)
+        time, fmt_addr, argc = fields[:3]
+        if fmt_addr == 0:
+            continue
+        records.append((time, fmt_addr, fields[3:3 + min(argc, 5)]))
+    # A ring dump starts anywhere, put it in time order
+    records.sort()
+    for time, fmt_addr, args in records:
+        text = format_record(table, fmt_addr, args)
+        print("[%d]%s" % (time // 1000, text.rstrip("\n")))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+#
+# Copyright 2021 Wenting Zhang <zephray@outlook.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# Extract the deferred syslog format strings from the firmware ELF, and
+# report what each log level costs.
+#
+# Usage: logstrings.py fw.elf fw.logstr
+#
+# Format strings in .syslog_fmt (compiled in) and .syslog_sites (every call
+# site, not loaded) start with a "<module>:<level>:" tag, see SYSLOG() in
+# syslog.h. Records carry the address of the format right after the tag.
+# Each fw.logstr line is that address in hex, a tab, and the format as a
+# Python literal. logdecode.py reads it back.
+#
+# The report lists per module and level how many call sites there are, how
+# many are compiled in, and the flash the others save: their strings
+# exactly, plus an estimate of the call site code (a record is filled in
+# and syslog_defer() called, about CALL_BYTES plus ARG_BYTES per argument
+# in Thumb). Cycles per call site are measured by BENCH_SYSLOG in bench.c.
+
+import re
+import struct
+import sys
+
+FMT_SECTION = ".syslog_fmt"
+SITES_SECTION = ".syslog_sites"
+LEVELS = ["ERR", "WARN", "INFO", "DEBUG"]
+CALL_BYTES = 16
+ARG_BYTES = 6
+CONVERSION = re.compile(r"%[^%a-zA-Z]*[a-zA-Z]")
+
+
+def read_section(elf, name):
+    if elf[:4] != b"\x7fELF" or elf[4] != 1 or elf[5] != 1:
+        raise ValueError("not a 32-bit little endian ELF")
+    shoff, = struct.unpack_from("<I", elf, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x2e)
+
+    def header(i):
+        # name, type, flags, addr, offset, size
+        return struct.unpack_from("<IIIIII", elf, shoff + i * shentsize)
+
+    strtab = header(shstrndx)
+    for i in range(shnum):
+        sh_name, _, _, addr, offset, size = header(i)
+        start = strtab[4] + sh_name
+        if elf[start:elf.index(b"\0", start)].decode() == name:
+            return addr, elf[offset:offset + size]
+    return None, b""
+
+
+def split_strings(addr, data):
+    # Strings are separate objects, possibly padded apart with NULs
+    strings = []
+    pos = 0
+    while pos < len(data):
+        if data[pos] == 0:
+            pos += 1
+            continue
+        end = data.index(b"\0", pos)
+        strings.append((addr + pos, data[pos:end].decode("latin-1")))
+        pos = end + 1
+    return strings
+
+
+def parse_tag(s):
+    module, level, fmt = s.split(":", 2)
+    return module, int(level), len(module) + len(level) + 2, fmt
+
+
+def site_bytes(s):
+    args = len(CONVERSION.findall(s.replace("%%", "")))
+    return len(s) + 1 + CALL_BYTES + ARG_BYTES * args
+
+
+def report(fmts, sites):
+    compiled = {}
+    for _, s in fmts:
+        compiled[s] = compiled.get(s, 0) + 1
+    rows = {}
+    for _, s in sites:
+        module, level, _, _ = parse_tag(s)
+        row = rows.setdefault((module, level), [0, 0, 0])
+        row[0] += 1
+        if compiled.get(s, 0):
+            compiled[s] -= 1
+            row[1] += 1
+        else:
+            row[2] += site_bytes(s)
+    print("Syslog sites:")
+    print("  %14s %7s %6s %3s %12s" % ("module", "level", "sites", "in",
+                                      "saved bytes"))
+    for (module, level), (n, used, saved) in sorted(rows.items()):
+        print("  %14s %7s %6d %3d %12d" % (module, LEVELS[level], n, used,
+                                          saved))
+
+
+def main():
+    if len(sys.argv) != 3:
+        print("Usage: %s fw.elf fw.logstr" % sys.argv[0], file=sys.stderr)
+        return 1
+    with open(sys.argv[1], "rb") as f:
+        elf = f.read()
+    strings = {}
+    for name in (FMT_SECTION, SITES_SECTION):
+        addr, data = read_section(elf, name)
+        strings[name] = split_strings(addr, data) if addr is not None else []
+    fmts = strings[FMT_SECTION]
+    with open(sys.argv[2], "w") as f:
+        for addr, s in fmts:
+            _, _, tag_len, fmt = parse_tag(s)
+            f.write("%08x\t%r\n" % (addr + tag_len, fmt))
+    print("Syslog string table: %d strings, %d bytes" %
+          (len(fmts), sum(len(s) + 1 for _, s in fmts)))
+    report(fmts, strings[SITES_SECTION])
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
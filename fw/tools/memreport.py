@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+#
+# Copyright 2021 Wenting Zhang <zephray@outlook.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# Per-symbol static RAM/flash breakdown of the firmware ELF.
+#
+# Usage: memreport.py [--nm arm-none-eabi-nm] [--top N] fw.elf
+#
+# Symbols are classified by their nm type letter: T/t/R/r live in flash,
+# D/d live in RAM with an initializer copy in flash, B/b live in RAM only.
+# Symbols in the RAM address range with code type (time critical functions)
+# count against both.
+
+import argparse
+import subprocess
+import sys
+
+FLASH_BASE = 0x10000000
+FLASH_END = 0x11000000
+
+
+def read_symbols(nm, elf):
+    out = subprocess.run([nm, "--print-size", "--size-sort", elf],
+                         check=True, capture_output=True, text=True).stdout
+    symbols = []
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) != 4:
+            continue
+        addr, size, kind, name = fields
+        symbols.append((int(addr, 16), int(size, 16), kind, name))
+    return symbols
+
+
+def classify(addr, kind):
+    in_flash = FLASH_BASE <= addr < FLASH_END
+    kind = kind.lower()
+    if kind in "tr":
+        return ("flash", 0) if in_flash else ("ram", 1)
+    if kind == "d":
+        return ("ram", 1)
+    if kind == "b":
+        return ("ram", 0)
+    return (None, 0)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--nm", default="arm-none-eabi-nm")
+    parser.add_argument("--top", type=int, default=20)
+    parser.add_argument("elf")
+    args = parser.parse_args()
+
+    flash = []
+    ram = []
+    flash_total = 0
+    ram_total = 0
+    for addr, size, kind, name in read_symbols(args.nm, args.elf):
+        region, has_init = classify(addr, kind)
+        if region == "flash":
+            flash.append((size, name))
+            flash_total += size
+        elif region == "ram":
+            ram.append((size, name))
+            ram_total += size
+            if has_init:
+                flash_total += size
+
+    print("Static RAM: %d bytes in %d symbols" % (ram_total, len(ram)))
+    for size, name in sorted(ram, reverse=True)[:args.top]:
+        print("  %8d  %s" % (size, name))
+    print("Flash: %d bytes in %d symbols" % (flash_total, len(flash)))
+    for size, name in sorted(flash, reverse=True)[:args.top]:
+        print("  %8d  %s" % (size, name))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+#
+# Copyright 2021 Wenting Zhang <zephray@outlook.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# Symbolize a prof_dump() capture against the firmware ELF.
+#
+# Usage: profsym.py [--nm arm-none-eabi-nm] [--folded out.folded] fw.elf dump.txt
+#
+# Prints a flat profile (samples per function) to stdout. With --folded, also
+# writes caller;callee lines built from the PC/LR samples, suitable as input
+# to flamegraph.pl. LR is only a hint of the caller: in non-leaf functions it
+# may be stale, so treat the call graph as approximate.
+
+import argparse
+import bisect
+import collections
+import subprocess
+import sys
+
+
+def read_functions(nm, elf):
+    out = subprocess.run([nm, "--print-size", "--numeric-sort", elf],
+                         check=True, capture_output=True, text=True).stdout
+    funcs = []
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) != 4 or fields[2] not in "Tt":
+            continue
+        # Clear the thumb bit
+        funcs.append((int(fields[0], 16) & ~1, int(fields[1], 16), fields[3]))
+    funcs.sort()
+    return funcs
+
+
+class Symbolizer:
+    def __init__(self, funcs):
+        self.funcs = funcs
+        self.addrs = [f[0] for f in funcs]
+
+    def lookup(self, addr):
+        addr &= ~1
+        i = bisect.bisect_right(self.addrs, addr) - 1
+        if i >= 0:
+            start, size, name = self.funcs[i]
+            if addr < start + max(size, 2):
+                return name
+        return "0x%08x" % addr
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--nm", default="arm-none-eabi-nm")
+    parser.add_argument("--folded")
+    parser.add_argument("elf")
+    parser.add_argument("dump")
+    args = parser.parse_args()
+
+    sym = Symbolizer(read_functions(args.nm, args.elf))
+    flat = collections.Counter()
+    folded = collections.Counter()
+    total = 0
+    outside = 0
+
+    with open(args.dump) as f:
+        for line in f:
+            fields = line.split()
+            if not fields:
+                continue
+            if fields[0] == "T":
+                total, outside = int(fields[1]), int(fields[2])
+            elif fields[0] == "P":
+                flat[sym.lookup(int(fields[1], 16))] += int(fields[2])
+            elif fields[0] == "S":
+                pc = sym.lookup(int(fields[1], 16))
+                lr = sym.lookup(int(fields[2], 16))
+                folded[pc if pc == lr else "%s;%s" % (lr, pc)] += 1
+
+    counted = sum(flat.values())
+    print("%d samples, %d outside flash text" % (total, outside))
+    for name, count in flat.most_common():
+        print("%6.2f%%  %8d  %s" % (100.0 * count / max(counted, 1), count,
+                                   name))
+
+    if args.folded:
+        with open(args.folded, "w") as f:
+            for stack, count in folded.most_common():
+                f.write("%s %d\n" % (stack, count))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
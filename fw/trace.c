@@ -0,0 +1,118 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <stdint.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "hardware/uart.h"
+#include "trace.h"
+
+#if (TRACE_SINK == TRACE_SINK_RAM) || (TRACE_SINK == TRACE_SINK_UART)
+
+static trace_event_t trace_ring[TRACE_RING_SIZE];
+static volatile uint32_t trace_wr;
+static uint32_t trace_rd;
+static uint32_t trace_drop;
+
+void __not_in_flash_func(trace_emit)(uint8_t id, uint16_t arg) {
+    uint32_t save = save_and_disable_interrupts();
+    uint32_t wr = trace_wr;
+#if TRACE_SINK == TRACE_SINK_UART
+    if ((wr - trace_rd) >= TRACE_RING_SIZE) {
+        trace_drop++;
+        restore_interrupts(save);
+        return;
+    }
+#endif
+    trace_event_t *ev = &trace_ring[wr & (TRACE_RING_SIZE - 1)];
+    ev->time = timer_hw->timerawl;
+    ev->id = id;
+    ev->arg = arg;
+    trace_wr = wr + 1;
+    restore_interrupts(save);
+}
+
+// Copy out up to max of the most recent events, oldest first
+int trace_snapshot(trace_event_t *events, int max) {
+    uint32_t save = save_and_disable_interrupts();
+    uint32_t wr = trace_wr;
+    uint32_t n = wr < TRACE_RING_SIZE ? wr : TRACE_RING_SIZE;
+    if (n > (uint32_t)max)
+        n = max;
+    for (uint32_t i = 0; i < n; i++)
+        events[i] = trace_ring[(wr - n + i) & (TRACE_RING_SIZE - 1)];
+    restore_interrupts(save);
+    return n;
+}
+
+uint32_t trace_dropped(void) {
+    return trace_drop;
+}
+
+#else
+
+int trace_snapshot(trace_event_t *events, int max) {
+    return 0;
+}
+
+uint32_t trace_dropped(void) {
+    return 0;
+}
+
+#endif
+
+#if TRACE_SINK == TRACE_SINK_UART
+// Byte position within the record currently being sent
+static int trace_tx_pos;
+
+void trace_poll(void) {
+    while ((trace_rd != trace_wr) && uart_is_writable(TRACE_UART)) {
+        trace_event_t *ev = &trace_ring[trace_rd & (TRACE_RING_SIZE - 1)];
+        uint8_t rec[8] = {
+            TRACE_UART_SYNC, ev->id, ev->arg, ev->arg >> 8,
+            ev->time, ev->time >> 8, ev->time >> 16, ev->time >> 24
+        };
+        uart_get_hw(TRACE_UART)->dr = rec[trace_tx_pos++];
+        if (trace_tx_pos == sizeof(rec)) {
+            trace_tx_pos = 0;
+            trace_rd++;
+        }
+    }
+}
+#else
+void trace_poll(void) {
+}
+#endif
+
+void trace_init(void) {
+#if TRACE_SINK == TRACE_SINK_GPIO
+    uint32_t mask = 0;
+    for (int i = 0; i < TRACE_ID_COUNT; i++)
+        if (trace_gpio_pin[i] != TRACE_GPIO_OFF)
+            mask |= 1u << trace_gpio_pin[i];
+    gpio_init_mask(mask);
+    gpio_set_dir_out_masked(mask);
+#elif TRACE_SINK == TRACE_SINK_UART
+    uart_init(TRACE_UART, TRACE_UART_BAUD);
+    gpio_set_function(TRACE_UART_TX, GPIO_FUNC_UART);
+#endif
+}
@@ -0,0 +1,105 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#pragma once
+
+#include <stdint.h>
+
+// Compile-time trace points. TRACE(id, arg) costs nothing unless a sink is
+// selected below, in which case each call emits one compact binary event:
+//   GPIO: toggles the event's pin from trace_gpio_pin[], arg is dropped.
+//         Meant for a logic analyzer, a single SIO store per event.
+//   RAM:  32-bit timestamp + id + 16-bit arg into a ring that overwrites the
+//         oldest events. Read it with a debugger or trace_snapshot().
+//   UART: same record queued into the ring and drained to the UART TX FIFO
+//         by trace_poll() from the main loop, never blocking. Events are
+//         dropped (and counted) when the ring is full.
+
+#define TRACE_SINK_NONE     (0)
+#define TRACE_SINK_GPIO     (1)
+#define TRACE_SINK_RAM      (2)
+#define TRACE_SINK_UART     (3)
+
+#ifndef TRACE_SINK
+#define TRACE_SINK          TRACE_SINK_NONE
+#endif
+
+#define TRACE_GPIO_OFF      (0xff)  // Event not traced by the GPIO sink
+#define TRACE_UART          uart0
+#define TRACE_UART_TX       (28)
+#define TRACE_UART_BAUD     (921600)
+#define TRACE_RING_SIZE     (256)   // Events, must be a power of 2
+
+// UART record: sync, id, arg (LE), timestamp (LE)
+#define TRACE_UART_SYNC     (0xa5)
+
+typedef enum {
+    TRACE_PD_STATE = 0,     // arg: new state
+    TRACE_PD_TX,            // arg: header
+    TRACE_PD_RX,            // arg: header
+    TRACE_PD_HARD_RESET,    // arg: 1 if sent, 0 if received
+    TRACE_TCPC_ALERT,       // arg: INTERRUPTA << 8 | INTERRUPT
+    TRACE_TCPC_GET_MSG,     // arg: header
+    TRACE_TCPC_TRANSMIT,    // arg: transmit type
+    TRACE_LCD_DMA_START,    // arg: byte count
+    TRACE_LCD_DMA_DONE,     // arg: 0
+    TRACE_SYSLOG,           // arg: message length
+    TRACE_ID_COUNT
+} trace_id_t;
+
+typedef struct {
+    uint32_t time;
+    uint8_t id;
+    uint8_t reserved;
+    uint16_t arg;
+} trace_event_t;
+
+void trace_init(void);
+void trace_poll(void);
+int trace_snapshot(trace_event_t *events, int max);
+uint32_t trace_dropped(void);
+
+#if TRACE_SINK == TRACE_SINK_NONE
+#define TRACE(id, arg) ((void)0)
+#elif TRACE_SINK == TRACE_SINK_GPIO
+#include "hardware/structs/sio.h"
+// Pin toggled by each event. GPIO16-19 are set aside for tracing, so four
+// events get a pin and the rest are off. Every pin belongs to one event, a
+// capture never mixes two. Move the pins around to trace other events.
+static const uint8_t trace_gpio_pin[TRACE_ID_COUNT] = {
+    [TRACE_PD_STATE]        = 16,
+    [TRACE_PD_TX]           = TRACE_GPIO_OFF,
+    [TRACE_PD_RX]           = TRACE_GPIO_OFF,
+    [TRACE_PD_HARD_RESET]   = TRACE_GPIO_OFF,
+    [TRACE_TCPC_ALERT]      = 17,
+    [TRACE_TCPC_GET_MSG]    = TRACE_GPIO_OFF,
+    [TRACE_TCPC_TRANSMIT]   = TRACE_GPIO_OFF,
+    [TRACE_LCD_DMA_START]   = 18,
+    [TRACE_LCD_DMA_DONE]    = 19,
+    [TRACE_SYSLOG]          = TRACE_GPIO_OFF,
+};
+// The id is always a constant, the lookup and the check fold away
+#define TRACE(id, arg) ((trace_gpio_pin[id] != TRACE_GPIO_OFF) ? \
+        (void)(sio_hw->gpio_togl = 1u << trace_gpio_pin[id]) : (void)0)
+#else
+void trace_emit(uint8_t id, uint16_t arg);
+#define TRACE(id, arg) trace_emit((id), (uint16_t)(arg))
+#endif
@@ -20,14 +20,22 @@
 // SOFTWARE.
 //
 #include <stdint.h>
-#include <stdio.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "pico/stdlib.h"
 #include "lcd.h"
+#include "gfx.h"
+#ifndef LCD_LINE_MODE
 #include "font.h"
+#endif
 #include "ui.h"
+#include "fmt.h"
+// Needs ROTATE_UI from ui.h
+#include "font_lcd.h"
 
-#define UI_PRINTF_BUFFER_SIZE 128
 
 #ifdef LARGE_UI
 const unsigned char ui_bg[168] = { /* 0X10,0X01,0X00,0X32,0X00,0X18, */
@@ -59,32 +67,373 @@ static void _lcd_set_pixel_large(size_t x, size_t y, bool on);
 #define FG_COLOR (0xffff)
 #endif
 
-#if 0
-static uint16_t switch_endian_16(uint16_t v) {
-    return (((v >> 8) & 0xff) | (v << 8));
-}
+// Dirty framebuffer windows in LCD coordinates, flushed by ui_update()
+static lcd_rect_t ui_dirty[LCD_MAX_WINDOWS];
+static int ui_dirty_count;
+
+// Rows [ui_clip_y1, ui_clip_y2) drawing is limited to, see ui_set_clip()
+static int ui_clip_y1 = 0;
+static int ui_clip_y2 = UI_HEIGHT;
+
+// Current time slice, 0 length for no limit
+static uint32_t ui_slice_start_us;
+static uint32_t ui_slice_us;
+static ui_yield_fn_t ui_yield_fn;
+
+#if defined(LCD_LINE_MODE) && defined(LARGE_UI)
+#error "LARGE_UI needs a framebuffer"
 #endif
 
+#ifndef LCD_LINE_MODE
 static void _lcd_set_pixel(size_t x, size_t y, uint16_t c) {
-    //framebuffer[y * LCD_WIDTH + x] = switch_endian_16(c);
 #ifdef ROTATE_UI
-    framebuffer[x * LCD_WIDTH + (LCD_HEIGHT - 1 - y)] = c;
+    lcd_fb_put(x * LCD_WIDTH + (LCD_WIDTH - 1 - y), LCD_FB_COLOR(c));
+#else
+    lcd_fb_put(y * LCD_WIDTH + x, LCD_FB_COLOR(c));
+#endif
+}
+#endif
+
+static int ui_rect_area(const lcd_rect_t *r) {
+    return (r->x2 - r->x1 + 1) * (r->y2 - r->y1 + 1);
+}
+
+static void ui_rect_union(lcd_rect_t *dst, const lcd_rect_t *src) {
+    if (src->x1 < dst->x1) dst->x1 = src->x1;
+    if (src->y1 < dst->y1) dst->y1 = src->y1;
+    if (src->x2 > dst->x2) dst->x2 = src->x2;
+    if (src->y2 > dst->y2) dst->y2 = src->y2;
+}
+
+// True if the rectangles overlap or are within UI_DIRTY_SLACK of each other
+static bool ui_rect_near(const lcd_rect_t *a, const lcd_rect_t *b) {
+    return (a->x1 <= b->x2 + UI_DIRTY_SLACK) && (b->x1 <= a->x2 + UI_DIRTY_SLACK) &&
+            (a->y1 <= b->y2 + UI_DIRTY_SLACK) && (b->y1 <= a->y2 + UI_DIRTY_SLACK);
+}
+
+// Grow dirty window idx by r, then fold in any other window it now touches
+static void ui_dirty_grow(int idx, const lcd_rect_t *r) {
+    ui_rect_union(&ui_dirty[idx], r);
+    for (int i = 0; i < ui_dirty_count; i++) {
+        if ((i != idx) && ui_rect_near(&ui_dirty[i], &ui_dirty[idx])) {
+            ui_rect_union(&ui_dirty[idx], &ui_dirty[i]);
+            ui_dirty[i] = ui_dirty[--ui_dirty_count];
+            if (idx == ui_dirty_count)
+                idx = i;
+            i = -1;
+        }
+    }
+}
+
+// Clip a UI area to the screen and convert it to LCD coordinates. Returns
+// false if nothing is left.
+static bool ui_to_lcd_rect(int x, int y, int w, int h, lcd_rect_t *r) {
+    if (x < 0) { w += x; x = 0; }
+    if (y < ui_clip_y1) { h -= ui_clip_y1 - y; y = ui_clip_y1; }
+    if (x + w > UI_WIDTH) w = UI_WIDTH - x;
+    if (y + h > ui_clip_y2) h = ui_clip_y2 - y;
+    if ((w <= 0) || (h <= 0))
+        return false;
+
+#ifdef ROTATE_UI
+    r->x1 = LCD_WIDTH - y - h;
+    r->x2 = LCD_WIDTH - 1 - y;
+    r->y1 = x;
+    r->y2 = x + w - 1;
 #else
-    framebuffer[y * LCD_WIDTH + x] = c;
+    r->x1 = x;
+    r->x2 = x + w - 1;
+    r->y1 = y;
+    r->y2 = y + h - 1;
 #endif
+    return true;
 }
 
+// Mark a UI area (UI coordinates) as needing to be sent to the LCD
+void ui_mark_dirty(int x, int y, int w, int h) {
+    lcd_rect_t r;
+    if (!ui_to_lcd_rect(x, y, w, h, &r))
+        return;
+
+    // Grow an existing window if it is close by, otherwise take a new slot,
+    // otherwise grow whichever window gets the least bigger
+    for (int i = 0; i < ui_dirty_count; i++) {
+        if (ui_rect_near(&ui_dirty[i], &r)) {
+            ui_dirty_grow(i, &r);
+            return;
+        }
+    }
+    if (ui_dirty_count < LCD_MAX_WINDOWS) {
+        ui_dirty[ui_dirty_count++] = r;
+        return;
+    }
+    int best = 0;
+    int best_growth = INT_MAX;
+    for (int i = 0; i < ui_dirty_count; i++) {
+        lcd_rect_t u = ui_dirty[i];
+        ui_rect_union(&u, &r);
+        int growth = ui_rect_area(&u) - ui_rect_area(&ui_dirty[i]);
+        if (growth < best_growth) {
+            best = i;
+            best_growth = growth;
+        }
+    }
+    ui_dirty_grow(best, &r);
+}
+
+// Send all dirty windows to the LCD
+void ui_update(void) {
+    if (!ui_dirty_count)
+        return;
+    lcd_update_rects(ui_dirty, ui_dirty_count);
+    ui_dirty_count = 0;
+}
+
+// Called by ui_slice_done(), returning true ends the slice
+void ui_set_yield_fn(ui_yield_fn_t fn) {
+    ui_yield_fn = fn;
+}
+
+// Give the following screen updates us microseconds, 0 for no limit
+void ui_slice_start(uint32_t us) {
+    ui_slice_start_us = time_us_32();
+    ui_slice_us = us;
+}
+
+// True once the slice is used up, or if PD wants the loop back
+bool ui_slice_done(void) {
+    if (!ui_slice_us)
+        return false;
+    if ((time_us_32() - ui_slice_start_us) >= ui_slice_us)
+        return true;
+    return ui_yield_fn && ui_yield_fn();
+}
+
+// Limit drawing to rows [y, y + h), h of 0 lifts the limit
+void ui_set_clip(int y, int h) {
+    if (h) {
+        ui_clip_y1 = (y < 0) ? 0 : y;
+        ui_clip_y2 = (y + h > UI_HEIGHT) ? UI_HEIGHT : (y + h);
+    }
+    else {
+        ui_clip_y1 = 0;
+        ui_clip_y2 = UI_HEIGHT;
+    }
+}
+
+// Show the full-width band of rows [y, y + h) rotated up by offset rows: row
+// y + offset is at the top and row y follows row y + h - 1. Nothing gets
+// redrawn, the LCD applies it on the way out. h of 0 turns it off.
+void ui_set_scroll(int y, int h, int offset) {
+#ifdef ROTATE_UI
+    // UI rows run right to left on the LCD
+    lcd_set_scroll(true, LCD_WIDTH - y - h, h, h ? (h - offset % h) : 0);
+#else
+    lcd_set_scroll(false, y, h, offset);
+#endif
+}
+
+#ifdef LCD_LINE_MODE
+// Character-cell mode. There is no framebuffer, the screen is a grid of
+// cells with their own colours, rendered a line at a time while the LCD DMA
+// is sending. Text is placed on the 6x8 cell grid, coordinates are rounded
+// down to it. A cell only gets marked dirty if it actually changes.
+#define UI_CELL_COLS (UI_WIDTH / 6)
+#define UI_CELL_ROWS (UI_HEIGHT / 8)
+
+typedef struct {
+    char c;
+    uint16_t fg;
+    uint16_t bg;
+} ui_cell_t;
+
+static ui_cell_t ui_cells[UI_CELL_ROWS][UI_CELL_COLS];
+// Colour of the strips the grid does not cover
+static uint16_t ui_border = BG_COLOR;
+
+static void ui_set_cell(int col, int row, char c, uint16_t fg, uint16_t bg) {
+    ui_cell_t *cell = &ui_cells[row][col];
+    if ((cell->c == c) && (cell->fg == fg) && (cell->bg == bg))
+        return;
+    cell->c = c;
+    cell->fg = fg;
+    cell->bg = bg;
+    ui_mark_dirty(col * 6, row * 8, 6, 8);
+}
+
+// Fill a range of cells with blanks
+static void ui_clear_cells(int col1, int row1, int col2, int row2,
+        uint16_t bg) {
+    if (col1 < 0) col1 = 0;
+    if (row1 < 0) row1 = 0;
+    if (col2 >= UI_CELL_COLS) col2 = UI_CELL_COLS - 1;
+    if (row2 >= UI_CELL_ROWS) row2 = UI_CELL_ROWS - 1;
+    for (int row = row1; row <= row2; row++)
+        for (int col = col1; col <= col2; col++)
+            ui_set_cell(col, row, ' ', FG_COLOR, bg);
+}
+
+// Pixels of one glyph row in line order, bit 0 first, with the cell spacing
+static inline void ui_render_span(uint16_t *p, uint32_t mask, int len,
+        const ui_cell_t *cell) {
+    for (int k = 0; k < len; k++)
+        p[k] = ((mask >> k) & 1) ? cell->fg : cell->bg;
+}
+
+// Blank for characters without a glyph, bytes from 0x80 up included
+static inline uint32_t ui_cell_mask(const ui_cell_t *cell, int row) {
+    unsigned g = (uint8_t)cell->c - FONT_LCD_FIRST;
+    if ((g >= FONT_LCD_GLYPHS) || (row >= FONT_LCD_ROWS))
+        return 0;
+    return font_lcd[g][row];
+}
+
+// lcd_line_fn_t, runs in the LCD DMA interrupt
+static void ui_render_line(int line, uint16_t *buf) {
+    for (int i = 0; i < LCD_WIDTH; i++)
+        buf[i] = ui_border;
+#ifdef ROTATE_UI
+    // LCD line is a UI column, crossing every cell row. Cell rows start from
+    // the right end of the line, the spacing pixel comes first.
+    int col = line / 6;
+    if (col >= UI_CELL_COLS)
+        return;
+    for (int row = 0; row < UI_CELL_ROWS; row++) {
+        const ui_cell_t *cell = &ui_cells[row][col];
+        ui_render_span(&buf[LCD_WIDTH - 8 - row * 8],
+                ui_cell_mask(cell, line % 6) << 1, 8, cell);
+    }
+#else
+    int row = line / 8;
+    if (row >= UI_CELL_ROWS)
+        return;
+    for (int col = 0; col < UI_CELL_COLS; col++) {
+        const ui_cell_t *cell = &ui_cells[row][col];
+        ui_render_span(&buf[col * 6], ui_cell_mask(cell, line % 8), 6, cell);
+    }
+#endif
+}
+
+void ui_disp_char(int x, int y, char c, uint16_t cl) {
+    if ((c < 0x20) || (x < 0) || (y < ui_clip_y1) || (y >= ui_clip_y2))
+        return;
+    int col = x / 6;
+    int row = y / 8;
+    if ((col >= UI_CELL_COLS) || (row >= UI_CELL_ROWS))
+        return;
+    ui_set_cell(col, row, c, cl, ui_cells[row][col].bg);
+}
+
+void ui_clear(uint16_t c) {
+    ui_set_scroll(0, 0, 0);
+    ui_border = c;
+    for (int row = 0; row < UI_CELL_ROWS; row++)
+        for (int col = 0; col < UI_CELL_COLS; col++)
+            ui_cells[row][col] = (ui_cell_t){' ', FG_COLOR, c};
+    ui_mark_dirty(0, 0, UI_WIDTH, UI_HEIGHT);
+}
+
+void ui_disp_fill(int x1, int y1, int x2, int y2, uint16_t c) {
+    ui_clear_cells(x1 / 6, y1 / 8, x2 / 6, y2 / 8, c);
+}
+
+// Scroll the band of rows [y, y + h) up by dy pixels, or down if dy is
+// negative, in whole cell rows. Uncovered rows are filled with c.
+void ui_scroll(int y, int h, int dy, uint16_t c) {
+    int row1 = y / 8;
+    int row2 = (y + h) / 8 - 1;
+    int n = dy / 8;
+    if (row1 < 0) row1 = 0;
+    if (row2 >= UI_CELL_ROWS) row2 = UI_CELL_ROWS - 1;
+    if ((n == 0) || (row1 > row2))
+        return;
+    if (abs(n) > row2 - row1) {
+        ui_clear_cells(0, row1, UI_CELL_COLS - 1, row2, c);
+        return;
+    }
+    if (n > 0) {
+        memmove(ui_cells[row1], ui_cells[row1 + n],
+                (row2 - row1 + 1 - n) * sizeof(ui_cells[0]));
+        ui_mark_dirty(0, row1 * 8, UI_WIDTH, (row2 - row1 + 1 - n) * 8);
+        ui_clear_cells(0, row2 - n + 1, UI_CELL_COLS - 1, row2, c);
+    }
+    else {
+        n = -n;
+        memmove(ui_cells[row1 + n], ui_cells[row1],
+                (row2 - row1 + 1 - n) * sizeof(ui_cells[0]));
+        ui_mark_dirty(0, (row1 + n) * 8, UI_WIDTH, (row2 - row1 + 1 - n) * 8);
+        ui_clear_cells(0, row1, UI_CELL_COLS - 1, row1 + n - 1, c);
+    }
+}
+#else
+#ifndef LARGE_UI
+// Character advance in the framebuffer, going right in the UI
+#ifdef ROTATE_UI
+#define UI_GLYPH_ADVANCE (6 * LCD_WIDTH)
+#else
+#define UI_GLYPH_ADVANCE (6)
+#endif
+
+// Draw a pre-rotated glyph, background included, with its top left corner
+// at pixel offset p in the framebuffer. Every row is one contiguous span.
+// colors are framebuffer values, see LCD_FB_COLOR(). Characters past the
+// font, bytes from 0x80 up as char is unsigned on the target, show blank.
+static void ui_blit_glyph(uint32_t p, char c, const uint16_t *colors) {
+    unsigned g = (uint8_t)c - FONT_LCD_FIRST;
+    const uint8_t *rows = font_lcd[(g < FONT_LCD_GLYPHS) ? g : 0];
+    for (int row = 0; row < FONT_LCD_ROWS; row++, p += LCD_WIDTH) {
+        uint32_t mask = rows[row];
+        for (int k = 0; k < FONT_LCD_SPAN; k++)
+            lcd_fb_put(p + k, colors[(mask >> k) & 1]);
+    }
+}
+
+// Framebuffer offset of a glyph's top left corner in LCD terms
+static uint32_t ui_glyph_offset(int x, int y) {
+#ifdef ROTATE_UI
+    return x * LCD_WIDTH + (LCD_WIDTH - 7 - y);
+#else
+    return y * LCD_WIDTH + x;
+#endif
+}
+
+// Draw n characters on one line. The whole run must be on screen.
+static void ui_disp_run(int x, int y, const char *str, int n, uint16_t cl) {
+    const uint16_t colors[2] = {LCD_FB_COLOR(BG_COLOR), LCD_FB_COLOR(cl)};
+    uint32_t p = ui_glyph_offset(x, y);
+
+    gfx_wait();
+    for (int i = 0; i < n; i++, p += UI_GLYPH_ADVANCE) {
+        if ((uint8_t)str[i] >= FONT_LCD_FIRST)
+            ui_blit_glyph(p, str[i], colors);
+    }
+    ui_mark_dirty(x, y, n * 6 - 1, 7);
+}
+#endif
+
 void ui_disp_char(int x, int y, char c, uint16_t cl) {
-    if (c < 0x20)
+    if ((uint8_t)c < 0x20)
         return;
-    c -= 0x20;
+#ifndef LARGE_UI
+    // Glyphs wholly on screen take the span path, the rest are clipped per
+    // pixel below
+    if ((x >= 0) && (y >= ui_clip_y1) && (x + 5 <= UI_WIDTH) &&
+            (y + 7 <= ui_clip_y2)) {
+        ui_disp_run(x, y, &c, 1, cl);
+        return;
+    }
+#endif
+    // font has 0x20-0x7f, anything above is drawn as a space
+    int g = ((uint8_t)c < 0x80) ? ((uint8_t)c - 0x20) : 0;
+    gfx_wait();
+    ui_mark_dirty(x, y, 5, 7);
     for (int yy = 0; yy < 7; yy++) {
-        if ((y + yy) < 0) continue;
-        if ((y + yy) >= UI_HEIGHT) continue;
+        if ((y + yy) < ui_clip_y1) continue;
+        if ((y + yy) >= ui_clip_y2) continue;
         for (int xx = 0; xx < 5; xx++) {
             if ((x + xx) < 0) continue;
             if ((x + xx) >= UI_WIDTH) continue;
-            if ((font[c * 5 + xx] >> yy) & 0x01) {
+            if ((font[g * 5 + xx] >> yy) & 0x01) {
 #ifdef LARGE_UI
                 _lcd_set_pixel_large(x + xx, y + yy, 1);
 #else
@@ -102,16 +451,65 @@ void ui_disp_char(int x, int y, char c, uint16_t cl) {
     }
 }
 
+// Clearing and filling run in the background, see gfx.h
 void ui_clear(uint16_t c) {
-    for (int i = 0; i < LCD_WIDTH * LCD_HEIGHT; i++) {
-        framebuffer[i] = BG_COLOR;
+    ui_set_scroll(0, 0, 0);
+    lcd_rect_t full = {0, 0, LCD_WIDTH - 1, LCD_HEIGHT - 1};
+    gfx_fill(&full, c);
+    ui_dirty[0] = full;
+    ui_dirty_count = 1;
+}
+
+void ui_disp_fill(int x1, int y1, int x2, int y2, uint16_t c) {
+    lcd_rect_t r;
+    if (!ui_to_lcd_rect(x1, y1, x2 - x1 + 1, y2 - y1 + 1, &r))
+        return;
+    gfx_fill(&r, c);
+    ui_mark_dirty(x1, y1, x2 - x1 + 1, y2 - y1 + 1);
+}
+
+// Scroll the full-width band of rows [y, y + h) up by dy pixels, or down if
+// dy is negative. Uncovered rows are filled with c.
+void ui_scroll(int y, int h, int dy, uint16_t c) {
+    if (y < ui_clip_y1) { h -= ui_clip_y1 - y; y = ui_clip_y1; }
+    if (y + h > ui_clip_y2) h = ui_clip_y2 - y;
+    int n = h - abs(dy);
+    if (n <= 0) {
+        ui_disp_fill(0, y, UI_WIDTH - 1, y + h - 1, c);
+        return;
     }
+
+    lcd_rect_t src, dst;
+    ui_to_lcd_rect(0, (dy > 0) ? (y + dy) : y, UI_WIDTH, n, &src);
+    ui_to_lcd_rect(0, (dy > 0) ? y : (y - dy), UI_WIDTH, n, &dst);
+    gfx_copy(&src, dst.x1, dst.y1);
+    if (dy > 0)
+        ui_disp_fill(0, y + n, UI_WIDTH - 1, y + h - 1, c);
+    else
+        ui_disp_fill(0, y, UI_WIDTH - 1, y - dy - 1, c);
+    ui_mark_dirty(0, y, UI_WIDTH, h);
 }
+#endif
 
 void ui_disp_string(int x, int y, char *str, uint16_t c) {
     while (*str) {
-        ui_disp_char(x, y, *str++, c);
-        x += 6;
+#if !defined(LARGE_UI) && !defined(LCD_LINE_MODE)
+        // Draw up to the wrap point in one go if the line is on screen
+        int n = 1;
+        while (str[n] && ((x + n * 6 + 6) <= UI_WIDTH))
+            n++;
+        if ((x >= 0) && (y >= ui_clip_y1) && (y + 7 <= ui_clip_y2) &&
+                (x + n * 6 - 1 <= UI_WIDTH)) {
+            ui_disp_run(x, y, str, n, c);
+            str += n;
+            x += n * 6;
+        }
+        else
+#endif
+        {
+            ui_disp_char(x, y, *str++, c);
+            x += 6;
+        }
         if ((x + 6) > UI_WIDTH) {
             y += 8;
             x = 0;
@@ -211,7 +609,7 @@ void ui_disp_bg(uint8_t *img) {
 
 void ui_init(void) {
     for (int i = 0; i < LCD_WIDTH * LCD_HEIGHT; i++) {
-        framebuffer[i] = switch_endian_16(BG_COLOR);
+        lcd_fb_put(i, LCD_FB_COLOR(BG_COLOR));
     }
     ui_disp_bg((uint8_t *)ui_bg);
 }
@@ -219,29 +617,59 @@ void ui_init(void) {
 // Small UI
 
 void ui_init(void) {
+#ifdef LCD_LINE_MODE
+    lcd_set_line_fn(ui_render_line);
+#endif
     ui_clear(BG_COLOR);
     ui_disp_string(0, 0, "Hello, world!", FG_COLOR);
 }
 
 #endif
 
+// ui_printf() output, drawn a row at a time with the same wrapping as
+// ui_disp_string()
+typedef struct {
+    int x;
+    int y;
+    int n;
+    char buf[UI_WIDTH / 6 + 1];
+} ui_printf_out_t;
+
+static void ui_printf_flush(ui_printf_out_t *out) {
+    if (!out->n)
+        return;
+    out->buf[out->n] = '\0';
+    ui_disp_string(out->x, out->y, out->buf, FG_COLOR);
+    out->x += out->n * 6;
+    out->n = 0;
+    if ((out->x + 6) > UI_WIDTH) {
+        out->y += 8;
+        out->x = 0;
+    }
+}
+
+static void ui_printf_put(void *ctx, char c) {
+    ui_printf_out_t *out = ctx;
+    out->buf[out->n++] = c;
+    if (((out->x + out->n * 6 + 6) > UI_WIDTH) ||
+            (out->n == sizeof(out->buf) - 1))
+        ui_printf_flush(out);
+}
+
 int ui_printf(int x, int y, const char *format, ...)
 {
-    char printf_buffer[UI_PRINTF_BUFFER_SIZE];
-
-    int length = 0;
+    ui_printf_out_t out = {.x = x, .y = y, .n = 0};
 
     va_list ap;
     va_start(ap, format);
 
-    length = vsnprintf(printf_buffer, UI_PRINTF_BUFFER_SIZE, format, ap);
+    int length = fmt_vformat(ui_printf_put, &out, format, ap);
 
     va_end(ap);
 
-    // display it for now
-    ui_disp_string(x, y, printf_buffer, FG_COLOR);
+    ui_printf_flush(&out);
 
-    lcd_update();
+    ui_update();
 
     return length;
-}
\ No newline at end of file
+}
@@ -21,8 +21,14 @@
 //
 #pragma once
 
-// Horizontal UI when the screen is vertical
+#include <stdint.h>
+#include <stdbool.h>
+
+// Horizontal UI when the screen is vertical. UI_NO_ROTATE turns it off from
+// the build, the host emulator renders both ways.
+#ifndef UI_NO_ROTATE
 #define ROTATE_UI
+#endif
 
 //#define LARGE_UI
 #define SMALL_UI
@@ -37,11 +43,34 @@
 #endif
 #endif
 
+// Dirty windows closer than this many pixels get merged
+#define UI_DIRTY_SLACK (8)
+
+// Time slicing. Screen updates that can run long, a full log redraw or the
+// I2C scan, work in bounded chunks of a line or a probe and check
+// ui_slice_done() between them. Once it is true they stop and carry on from
+// there on their next call, so the main loop gets back to PD within a slice
+// and a chunk whatever is on screen. The yield callback can end a slice
+// early when PD has work due. An update that stops with drawing not yet
+// flushed by ui_update() holds the LCD with lcd_hold() until it is done.
+#define UI_SLICE_US (500)
+
+typedef bool (*ui_yield_fn_t)(void);
+
 void ui_init(void);
+void ui_set_yield_fn(ui_yield_fn_t fn);
+void ui_slice_start(uint32_t us);
+bool ui_slice_done(void);
+void ui_mark_dirty(int x, int y, int w, int h);
+void ui_update(void);
 void ui_clear(uint16_t c);
+void ui_disp_char(int x, int y, char c, uint16_t cl);
 void ui_disp_string(int x, int y, char *str, uint16_t c);
 int ui_disp_string_bb(char *str, int width);
-//void ui_disp_fill(int x1, int y1, int x2, int y2, uint16_t c);
+void ui_disp_fill(int x1, int y1, int x2, int y2, uint16_t c);
+void ui_scroll(int y, int h, int dy, uint16_t c);
+void ui_set_scroll(int y, int h, int offset);
+void ui_set_clip(int y, int h);
 void ui_disp_num(int x, int y, uint32_t num, uint16_t c);
 void ui_disp_hex(int x, int y, uint32_t num, uint16_t c);
 int ui_printf(int x, int y, const char *format, ...);
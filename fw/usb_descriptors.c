@@ -0,0 +1,102 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include "tusb.h"
+
+// Descriptors for the USB log stream: one CDC ACM interface, see
+// logstream.h. Same VID/PID as the SDK's USB stdio.
+
+#define USBD_VID            (0x2e8a)    // Raspberry Pi
+#define USBD_PID            (0x000a)    // Pico SDK CDC
+
+#define USBD_ITF_CDC        (0)         // Needs 2 interfaces
+#define USBD_ITF_MAX        (2)
+
+#define USBD_CDC_EP_CMD     (0x81)
+#define USBD_CDC_EP_OUT     (0x02)
+#define USBD_CDC_EP_IN      (0x82)
+#define USBD_CDC_CMD_SIZE   (8)
+#define USBD_CDC_DATA_SIZE  (64)
+
+#define USBD_CONFIG_LEN     (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN)
+
+#define USBD_STR_MANUF      (1)
+#define USBD_STR_PRODUCT    (2)
+#define USBD_STR_SERIAL     (3)
+#define USBD_STR_CDC        (4)
+
+static const tusb_desc_device_t usbd_desc_device = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = 0x0200,
+    .bDeviceClass = TUSB_CLASS_MISC,
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+    .idVendor = USBD_VID,
+    .idProduct = USBD_PID,
+    .bcdDevice = 0x0100,
+    .iManufacturer = USBD_STR_MANUF,
+    .iProduct = USBD_STR_PRODUCT,
+    .iSerialNumber = USBD_STR_SERIAL,
+    .bNumConfigurations = 1,
+};
+
+static const uint8_t usbd_desc_cfg[USBD_CONFIG_LEN] = {
+    TUD_CONFIG_DESCRIPTOR(1, USBD_ITF_MAX, 0, USBD_CONFIG_LEN, 0, 100),
+    TUD_CDC_DESCRIPTOR(USBD_ITF_CDC, USBD_STR_CDC, USBD_CDC_EP_CMD,
+            USBD_CDC_CMD_SIZE, USBD_CDC_EP_OUT, USBD_CDC_EP_IN,
+            USBD_CDC_DATA_SIZE),
+};
+
+static const char *const usbd_desc_str[] = {
+    [USBD_STR_MANUF] = "zephray",
+    [USBD_STR_PRODUCT] = "PenabledDisplay",
+    [USBD_STR_SERIAL] = "0",
+    [USBD_STR_CDC] = "Syslog",
+};
+
+const uint8_t *tud_descriptor_device_cb(void) {
+    return (const uint8_t *)&usbd_desc_device;
+}
+
+const uint8_t *tud_descriptor_configuration_cb(uint8_t index) {
+    return usbd_desc_cfg;
+}
+
+const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
+    static uint16_t desc_str[32];
+    int len;
+
+    if (index == 0) {
+        desc_str[1] = 0x0409;   // English
+        len = 1;
+    } else {
+        if (index >= sizeof(usbd_desc_str) / sizeof(usbd_desc_str[0]))
+            return NULL;
+        const char *str = usbd_desc_str[index];
+        for (len = 0; (len < 31) && str[len]; len++)
+            desc_str[1 + len] = str[len];
+    }
+    // Length in bytes including the header, then the descriptor type
+    desc_str[0] = (TUSB_DESC_STRING << 8) | (2 * len + 2);
+    return desc_str;
+}
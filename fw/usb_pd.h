@@ -1702,6 +1702,101 @@ void pd_transmit_complete(int port, int status);
  */
 int pd_get_polarity(int port);
 
+/**
+ * Get the current PD state, one of enum pd_states.
+ *
+ * @param port USB-C port number
+ */
+int pd_get_task_state(int port);
+
+/**
+ * Get the port flags, see PD_FLAGS_*.
+ *
+ * @param port USB-C port number
+ */
+uint32_t pd_get_flags(int port);
+
+/**
+ * Get the data role, PD_ROLE_UFP or PD_ROLE_DFP.
+ *
+ * @param port USB-C port number
+ */
+int pd_get_data_role(int port);
+
+/**
+ * Get the negotiated contract.
+ *
+ * @param port USB-C port number
+ * @param mv Filled in with the supply voltage
+ * @param ma Filled in with the current limit
+ * @return 1 if there is an explicit contract, 0 otherwise
+ */
+int pd_get_contract(int port, uint32_t *mv, uint32_t *ma);
+
+/**
+ * Check whether the state machine has something due: a state or VDM
+ * timeout that expired, or a VDM waiting to be sent. Messages from the
+ * partner are not seen until the TCPC is polled.
+ *
+ * @param port USB-C port number
+ * @return 1 if pd_run_state_machine() should run now
+ */
+int pd_work_pending(int port);
+
+/* Contract kept over a warm restart, see pd_warm_restart() */
+struct pd_warm_state {
+	uint8_t polarity;
+	uint8_t data_role;
+	uint8_t rev;
+	uint8_t requested_idx;
+	uint16_t supply_voltage;	/* mV */
+	uint16_t curr_limit;		/* mA */
+};
+
+/**
+ * Get the contract to keep over a warm restart.
+ *
+ * @param port USB-C port number
+ * @param s Filled in if there is an explicit contract as a sink
+ * @return 1 if there is one, 0 otherwise
+ */
+int pd_get_warm_state(int port, struct pd_warm_state *s);
+
+/**
+ * Resume a contract after a warm restart with a soft reset, to be called
+ * right after pd_init().
+ *
+ * @param port USB-C port number
+ * @param s State saved with pd_get_warm_state() before the restart
+ * @return 1 if the partner is still attached and the resync was started
+ */
+int pd_warm_restart(int port, const struct pd_warm_state *s);
+
+/**
+ * Restore the DisplayPort alternate mode state after a warm restart.
+ *
+ * @param port USB-C port number
+ * @param opos Object position of the entered mode, 0 if none
+ * @param enabled DP configured
+ * @param pins Pin assignment of the DP configuration, MODE_DP_PIN_*
+ */
+void pd_restore_alt_mode(int port, int opos, int enabled, int pins);
+
+/**
+ * Get the DisplayPort pin assignment the source configured.
+ *
+ * @param port USB-C port number
+ * @return One of MODE_DP_PIN_*, 0 if DP is not configured
+ */
+int pd_dp_pin_config(int port);
+
+/**
+ * Check whether a VDM exchange is in progress.
+ *
+ * @param port USB-C port number
+ */
+bool pd_is_vdm_busy(int port);
+
 /**
  * Get port partner data swap capable status
  *
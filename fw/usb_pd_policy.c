@@ -14,9 +14,11 @@
 #ifdef CONFIG_COMMON_RUNTIME
 #define CPRINTS(format, args...) cprints(CC_USBPD, format, ## args)
 #define CPRINTF(format, args...) cprintf(CC_USBPD, format, ## args)
+#define CPRINTF_ERR CPRINTF
 #else
-#define CPRINTS(format, args...) syslog_printf(format, ## args)
-#define CPRINTF(format, args...) syslog_printf(format, ## args)
+#define CPRINTS(format, args...) SYSLOG(POLICY, SYSLOG_INFO, format, ## args)
+#define CPRINTF(format, args...) SYSLOG(POLICY, SYSLOG_INFO, format, ## args)
+#define CPRINTF_ERR(format, args...) SYSLOG(POLICY, SYSLOG_ERR, format, ## args)
 #endif
 
 static int rw_flash_changed = 1;
@@ -144,7 +146,7 @@ void pd_extract_pdo_power(uint32_t pdo, uint32_t *ma, uint32_t *mv)
 	*mv = ((pdo >> 10) & 0x3FF) * 50;
 
 	if (*mv == 0) {
-		CPRINTF("ERR:PDO mv=0\n");
+		CPRINTF_ERR("ERR:PDO mv=0\n");
 		*ma = 0;
 		return;
 	}
@@ -315,7 +317,7 @@ static void dfp_consume_svids(int port, uint32_t *payload)
 
 	for (i = pe[port].svid_cnt; i < pe[port].svid_cnt + 12; i += 2) {
 		if (i == SVID_DISCOVERY_MAX) {
-			CPRINTF("ERR:SVIDCNT\n");
+			CPRINTF_ERR("ERR:SVIDCNT\n");
 			break;
 		}
 
@@ -334,7 +336,7 @@ static void dfp_consume_svids(int port, uint32_t *payload)
 	}
 	/* TODO(tbroch) need to re-issue discover svids if > 12 */
 	if (i && ((i % 12) == 0))
-		CPRINTF("ERR:SVID+12\n");
+		CPRINTF_ERR("ERR:SVID+12\n");
 }
 
 static int dfp_discover_modes(int port, uint32_t *payload)
@@ -351,7 +353,7 @@ static void dfp_consume_modes(int port, int cnt, uint32_t *payload)
 	int idx = pe[port].svid_idx;
 	pe[port].svids[idx].mode_cnt = cnt - 1;
 	if (pe[port].svids[idx].mode_cnt < 0) {
-		CPRINTF("ERR:NOMODE\n");
+		CPRINTF_ERR("ERR:NOMODE\n");
 	} else {
 		memcpy(pe[port].svids[pe[port].svid_idx].mode_vdo, &payload[1],
 		       sizeof(uint32_t) * pe[port].svids[idx].mode_cnt);
@@ -396,7 +398,7 @@ int allocate_mode(int port, uint16_t svid)
 
 	/* There's no space to enter another mode */
 	if (pe[port].amode_idx == PD_AMODE_COUNT) {
-		CPRINTF("ERR:NO AMODE SPACE\n");
+		CPRINTF_ERR("ERR:NO AMODE SPACE\n");
 		return -1;
 	}
 
@@ -441,7 +443,7 @@ uint32_t pd_dfp_enter_mode(int port, uint16_t svid, int opos)
 	} else if (opos <= modep->data->mode_cnt) {
 		modep->opos = opos;
 	} else {
-		CPRINTF("opos error\n");
+		CPRINTF_ERR("opos error\n");
 		return 0;
 	}
 
@@ -460,13 +462,13 @@ static int validate_mode_request(struct svdm_amode_data *modep,
 		return 0;
 
 	if (svid != modep->fx->svid) {
-		CPRINTF("ERR:svid r:0x%04x != c:0x%04x\n",
+		CPRINTF_ERR("ERR:svid r:0x%04x != c:0x%04x\n",
 			svid, modep->fx->svid);
 		return 0;
 	}
 
 	if (opos != modep->opos) {
-		CPRINTF("ERR:opos r:%d != c:%d\n",
+		CPRINTF_ERR("ERR:opos r:%d != c:%d\n",
 			opos, modep->opos);
 		return 0;
 	}
@@ -697,7 +699,7 @@ int pd_svdm(int port, int cnt, uint32_t *payload, uint32_t **rpayload)
 			return 0;
 #endif
 		default:
-			CPRINTF("ERR:CMD:%d\n", cmd);
+			CPRINTF_ERR("ERR:CMD:%d\n", cmd);
 			rsize = 0;
 		}
 		if (func)
@@ -785,7 +787,7 @@ int pd_svdm(int port, int cnt, uint32_t *payload, uint32_t **rpayload)
 			rsize = 0;
 			break;
 		default:
-			CPRINTF("ERR:CMD:%d\n", cmd);
+			CPRINTF_ERR("ERR:CMD:%d\n", cmd);
 			rsize = 0;
 		}
 
@@ -802,7 +804,7 @@ int pd_svdm(int port, int cnt, uint32_t *payload, uint32_t **rpayload)
 			break;
 		case CMD_ENTER_MODE:
 			/* Error */
-			CPRINTF("ERR:ENTBUSY\n");
+			CPRINTF_ERR("ERR:ENTBUSY\n");
 			rsize = 0;
 			break;
 		case CMD_EXIT_MODE:
@@ -816,7 +818,7 @@ int pd_svdm(int port, int cnt, uint32_t *payload, uint32_t **rpayload)
 		rsize = 0;
 #endif /* CONFIG_USB_PD_ALT_MODE_DFP */
 	} else {
-		CPRINTF("ERR:CMDT:%d\n", cmd);
+		CPRINTF_ERR("ERR:CMDT:%d\n", cmd);
 		/* do not answer */
 		rsize = 0;
 	}
@@ -1038,6 +1040,8 @@ void pd_set_vbus_discharge(int port, int enable)
 /* Whether alternate mode has been entered or not */
 static int alt_mode = 0;
 int dp_enabled = 0;
+/* Pin assignment from the last DP configure, MODE_DP_PIN_* */
+static int dp_pins = 0;
 
 /* ----------------- Vendor Defined Messages ------------------ */
 const uint32_t vdo_idh = VDO_IDH(0, /* data caps as USB host */
@@ -1099,6 +1103,7 @@ static int dp_config(int port, uint32_t *payload)
 	CPRINTF("DP config %08x\n", payload[1]);
 	if (PD_DP_CFG_DPON(payload[1])) {
 		dp_enabled = 1;
+		dp_pins = PD_DP_CFG_PIN(payload[1]);
 	}
 
 	return 1;
@@ -1140,11 +1145,24 @@ int pd_alt_mode(int port, uint16_t svid)
 	return alt_mode;
 }
 
+void pd_restore_alt_mode(int port, int opos, int enabled, int pins)
+{
+	alt_mode = opos;
+	dp_enabled = enabled;
+	dp_pins = enabled ? pins : 0;
+}
+
+int pd_dp_pin_config(int port)
+{
+	return dp_enabled ? dp_pins : 0;
+}
+
 static int svdm_exit_mode(int port, uint32_t *payload)
 {
 	CPRINTF("SVDM exit mode\n");
 	alt_mode = 0;
 	dp_enabled = 0;
+	dp_pins = 0;
 	return 1; /* Must return ACK */
 }
 
@@ -11,10 +11,16 @@
 #include "tcpm.h"
 #include "usb_pd_driver.h"
 #include "syslog.h"
+#include "trace.h"
 
 #ifdef CONFIG_COMMON_RUNTIME
 #define CPRINTF(format, args...) cprintf(CC_USBPD, format, ## args)
 #define CPRINTS(format, args...) cprints(CC_USBPD, format, ## args)
+#define CPRINTF_DBG CPRINTF
+#define CPRINTS_WARN CPRINTS
+#define CPRINTF_WARN CPRINTF
+#define CPRINTS_ERR CPRINTS
+#define CPRINTF_ERR CPRINTF
 
 BUILD_ASSERT(CONFIG_USB_PD_PORT_COUNT <= EC_USB_PD_MAX_PORTS);
 
@@ -43,9 +49,15 @@ static int debug_level;
  */
 static uint8_t pd_comm_enabled[CONFIG_USB_PD_PORT_COUNT];
 #else /* CONFIG_COMMON_RUNTIME */
-#define CPRINTF(format, args...) syslog_printf(format, ## args)
-#define CPRINTS(format, args...) syslog_printf(format, ## args)
-static const int debug_level = 1;
+#define CPRINTF(format, args...) SYSLOG(PD, SYSLOG_INFO, format, ## args)
+#define CPRINTS(format, args...) SYSLOG(PD, SYSLOG_INFO, format, ## args)
+#define CPRINTF_DBG(format, args...) SYSLOG(PD, SYSLOG_DEBUG, format, ## args)
+#define CPRINTS_WARN(format, args...) SYSLOG(PD, SYSLOG_WARN, format, ## args)
+#define CPRINTF_WARN(format, args...) SYSLOG(PD, SYSLOG_WARN, format, ## args)
+#define CPRINTS_ERR(format, args...) SYSLOG(PD, SYSLOG_ERR, format, ## args)
+#define CPRINTF_ERR(format, args...) SYSLOG(PD, SYSLOG_ERR, format, ## args)
+// Packet logs are in, SYSLOG_LEVEL_PD decides whether they get compiled
+static const int debug_level = 2;
 #endif
 
 #ifdef CONFIG_USB_PD_DUAL_ROLE
@@ -419,7 +431,8 @@ static inline void set_state(int port, enum pd_states next_state)
 		disable_sleep(SLEEP_MASK_USB_PD);
 #endif
 
-	CPRINTF("C%d st%d\n", port, next_state);
+	TRACE(TRACE_PD_STATE, next_state);
+	CPRINTF_DBG("C%d st%d\n", port, next_state);
 }
 
 /* increment message ID counter */
@@ -459,6 +472,7 @@ static int pd_transmit(int port, enum tcpm_transmit_type type,
 	/* If comms are disabled, do not transmit, return error */
 	if (!pd_comm_is_enabled(port))
 		return -1;
+	TRACE(TRACE_PD_TX, header);
 #ifdef CONFIG_USB_PD_REV30
 	/* Source-coordinated collision avoidance */
 	/*
@@ -576,7 +590,7 @@ static int send_control(int port, int type)
 
 	bit_len = pd_transmit(port, TCPC_TX_SOP, header, NULL);
 	if (debug_level >= 2)
-		CPRINTF("CTRL[%d]>%d\n", type, bit_len);
+		CPRINTF_DBG("CTRL[%d]>%d\n", type, bit_len);
 
 	return bit_len;
 }
@@ -606,7 +620,7 @@ static int send_source_cap(int port)
 
 	bit_len = pd_transmit(port, TCPC_TX_SOP, header, src_pdo);
 	if (debug_level >= 2)
-		CPRINTF("srcCAP>%d\n", bit_len);
+		CPRINTF_DBG("srcCAP>%d\n", bit_len);
 
 	return bit_len;
 }
@@ -693,7 +707,7 @@ static int send_battery_cap(int port, uint32_t *payload)
 
 	bit_len = pd_transmit(port, TCPC_TX_SOP, header, (uint32_t *)msg);
 	if (debug_level >= 2)
-		CPRINTF("batCap>%d\n", bit_len);
+		CPRINTF_DBG("batCap>%d\n", bit_len);
 	return bit_len;
 }
 
@@ -760,7 +774,7 @@ static int send_battery_status(int port,  uint32_t *payload)
 
 	bit_len = pd_transmit(port, TCPC_TX_SOP, header, &msg);
 	if (debug_level >= 2)
-		CPRINTF("batStat>%d\n", bit_len);
+		CPRINTF_DBG("batStat>%d\n", bit_len);
 
 	return bit_len;
 }
@@ -776,7 +790,7 @@ static void send_sink_cap(int port)
 
 	bit_len = pd_transmit(port, TCPC_TX_SOP, header, pd_snk_pdo);
 	if (debug_level >= 2)
-		CPRINTF("snkCAP>%d\n", bit_len);
+		CPRINTF_DBG("snkCAP>%d\n", bit_len);
 }
 
 static int send_request(int port, uint32_t rdo)
@@ -788,7 +802,7 @@ static int send_request(int port, uint32_t rdo)
 
 	bit_len = pd_transmit(port, TCPC_TX_SOP, header, &rdo);
 	if (debug_level >= 2)
-		CPRINTF("REQ%d>\n", bit_len);
+		CPRINTF_DBG("REQ%d>\n", bit_len);
 
 	return bit_len;
 }
@@ -799,7 +813,7 @@ static int pd_get_saved_active(int port)
 
 	if (system_get_bbram(port ? SYSTEM_BBRAM_IDX_PD1 :
 				    SYSTEM_BBRAM_IDX_PD0, &val)) {
-		CPRINTS("PD NVRAM FAIL");
+		CPRINTS_ERR("PD NVRAM FAIL");
 		return 0;
 	}
 	return !!val;
@@ -809,7 +823,7 @@ static void pd_set_saved_active(int port, int val)
 {
 	if (system_set_bbram(port ? SYSTEM_BBRAM_IDX_PD1 :
 				    SYSTEM_BBRAM_IDX_PD0, val))
-		CPRINTS("PD NVRAM FAIL");
+		CPRINTS_ERR("PD NVRAM FAIL");
 }
 #endif // CONFIG_BBRAM
 #endif /* CONFIG_USB_PD_DUAL_ROLE */
@@ -825,7 +839,7 @@ static int send_bist_cmd(int port)
 			pd_get_rev(port), 0);
 
 	bit_len = pd_transmit(port, TCPC_TX_SOP, header, &bdo);
-	CPRINTF("BIST>%d\n", bit_len);
+	CPRINTF_DBG("BIST>%d\n", bit_len);
 
 	return bit_len;
 }
@@ -846,7 +860,7 @@ static void handle_vdm_request(int port, int cnt, uint32_t *payload)
 	int rlen = 0;
 	uint32_t *rdata;
 
-	CPRINTF("VDM request");
+	CPRINTF_DBG("VDM request");
 	if (pd[port].vdm_state == VDM_STATE_BUSY) {
 		/* If UFP responded busy retry after timeout */
 		if (PD_VDO_CMDT(payload[0]) == CMDT_RSP_BUSY) {
@@ -871,12 +885,14 @@ static void handle_vdm_request(int port, int cnt, uint32_t *payload)
 		return;
 	}
 	if (debug_level >= 2)
-		CPRINTF("Unhandled VDM VID %04x CMD %04x\n",
+		CPRINTF_DBG("Unhandled VDM VID %04x CMD %04x\n",
 			PD_VDO_VID(payload[0]), payload[0] & 0xFFFF);
 }
 
 void pd_execute_hard_reset(int port)
 {
+	TRACE(TRACE_PD_HARD_RESET,
+	      pd[port].last_state == PD_STATE_HARD_RESET_SEND);
 	if (pd[port].last_state == PD_STATE_HARD_RESET_SEND)
 		CPRINTF("C%d HARD RST TX\n", port);
 	else
@@ -1192,7 +1208,7 @@ static void handle_data_request(int port, uint16_t head,
 		handle_vdm_request(port, cnt, payload);
 		break;
 	default:
-		CPRINTF("Unhandled data message type %d\n", type);
+		CPRINTF_WARN("Unhandled data message type %d\n", type);
 	}
 }
 
@@ -1510,7 +1526,7 @@ static void handle_ctrl_request(int port, uint16_t head,
 #ifdef CONFIG_USB_PD_REV30
 		send_control(port, PD_CTRL_NOT_SUPPORTED);
 #endif
-		CPRINTF("Unhandled ctrl message type %d\n", type);
+		CPRINTF_WARN("Unhandled ctrl message type %d\n", type);
 	}
 }
 
@@ -1540,13 +1556,15 @@ static void handle_request(int port, uint16_t head,
 	int cnt = PD_HEADER_CNT(head);
 	int p;
 
+	TRACE(TRACE_PD_RX, head);
+
 	/* dump received packet content (only dump ping at debug level 3) */
 	if ((debug_level == 2 && PD_HEADER_TYPE(head) != PD_CTRL_PING) ||
 	    debug_level >= 3) {
-		CPRINTF("RECV %04x/%d ", head, cnt);
+		CPRINTF_DBG("RECV %04x/%d ", head, cnt);
 		for (p = 0; p < cnt; p++)
-			CPRINTF("[%d]%08x ", p, payload[p]);
-		CPRINTF("\n");
+			CPRINTF_DBG("[%d]%08x ", p, payload[p]);
+		CPRINTF_DBG("\n");
 	}
 
 	/*
@@ -1573,7 +1591,7 @@ void pd_send_vdm(int port, uint32_t vid, int cmd, const uint32_t *data,
 		 int count)
 {
 	if (count > VDO_MAX_SIZE - 1) {
-		CPRINTF("VDM over max size\n");
+		CPRINTF_WARN("VDM over max size\n");
 		return;
 	}
 
@@ -1636,7 +1654,7 @@ static void pd_vdm_send_state_machine(int port)
 
 	/*static int old_vdm_state = 0;
 	if (pd[port].vdm_state != old_vdm_state) {
-		CPRINTF("VDM state: %d\n", pd[port].vdm_state);
+		CPRINTF_DBG("VDM state: %d\n", pd[port].vdm_state);
 		old_vdm_state = pd[port].vdm_state;
 	}*/
 
@@ -1887,6 +1905,47 @@ int pd_get_polarity(int port)
 	return pd[port].polarity;
 }
 
+int pd_get_task_state(int port)
+{
+	return pd[port].task_state;
+}
+
+uint32_t pd_get_flags(int port)
+{
+	return pd[port].flags;
+}
+
+int pd_get_data_role(int port)
+{
+	return pd[port].data_role;
+}
+
+int pd_get_contract(int port, uint32_t *mv, uint32_t *ma)
+{
+#ifdef CONFIG_USB_PD_DUAL_ROLE
+	if (!(pd[port].flags & PD_FLAGS_EXPLICIT_CONTRACT))
+		return 0;
+	*mv = pd[port].supply_voltage;
+	*ma = pd[port].curr_limit;
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+int pd_work_pending(int port)
+{
+	uint64_t now = get_time().val;
+
+	if (pd[port].timeout && now >= pd[port].timeout)
+		return 1;
+	if (pd[port].vdm_state == VDM_STATE_READY)
+		return 1;
+	return (pd[port].vdm_state == VDM_STATE_BUSY ||
+		pd[port].vdm_state == VDM_STATE_WAIT_RSP_BUSY) &&
+	       now > pd[port].vdm_timeout.val;
+}
+
 int pd_get_partner_data_swap_capable(int port)
 {
 	/* return data swap capable status of port partner */
@@ -2125,6 +2184,58 @@ void pd_init(int port)
 #endif
 }
 
+#ifdef CONFIG_USB_PD_DUAL_ROLE
+int pd_get_warm_state(int port, struct pd_warm_state *s)
+{
+	if (pd[port].task_state != PD_STATE_SNK_READY ||
+	    !(pd[port].flags & PD_FLAGS_EXPLICIT_CONTRACT))
+		return 0;
+
+	s->polarity = pd[port].polarity;
+	s->data_role = pd[port].data_role;
+	s->rev = pd_get_rev(port);
+	s->requested_idx = pd[port].requested_idx;
+	s->supply_voltage = pd[port].supply_voltage;
+	s->curr_limit = pd[port].curr_limit;
+	return 1;
+}
+
+/*
+ * Resume a contract the partner still holds after we restarted, instead of
+ * starting over from a detach. Call right after pd_init(). The CC debounce
+ * is skipped and a soft reset resyncs the message IDs, which keeps the
+ * contract and the alternate modes on the partner's side.
+ */
+int pd_warm_restart(int port, const struct pd_warm_state *s)
+{
+	int cc1, cc2;
+
+	tcpm_get_cc(port, &cc1, &cc2);
+	if (!(cc_is_rp(cc1) || cc_is_rp(cc2)) || !pd_is_vbus_present(port) ||
+	    get_snk_polarity(cc1, cc2) != s->polarity)
+		return 0;
+
+	pd[port].polarity = s->polarity;
+	tcpm_set_polarity(port, pd[port].polarity);
+	pd[port].msg_id = 0;
+	pd_set_data_role(port, s->data_role);
+#ifdef CONFIG_USB_PD_REV30
+	pd[port].rev = s->rev;
+#endif
+	pd[port].requested_idx = s->requested_idx;
+	pd[port].supply_voltage = s->supply_voltage;
+	pd[port].curr_limit = s->curr_limit;
+	pd[port].cc_state = PD_CC_DFP_ATTACHED;
+	/* Go to a soft reset again if the source caps never come */
+	pd[port].flags |= PD_FLAGS_VBUS_NEVER_LOW | PD_FLAGS_PREVIOUS_PD_CONN;
+	if (pd_comm_is_enabled(port))
+		tcpm_set_rx_enable(port, 1);
+	set_state(port, PD_STATE_SOFT_RESET);
+	CPRINTS("C%d warm restart", port);
+	return 1;
+}
+#endif
+
 void pd_run_state_machine(int port)
 {
 #ifdef CONFIG_USB_PD_REV30
@@ -2161,9 +2272,9 @@ void pd_run_state_machine(int port)
 #else
 	/* if TCPC has reset, then need to initialize it again */
 	if (evt & PD_EVENT_TCPC_RESET) {
-		CPRINTS("TCPC p%d reset!", port);
+		CPRINTS_WARN("TCPC p%d reset!", port);
 		if (tcpm_init(port) != EC_SUCCESS)
-			CPRINTS("TCPC p%d init failed", port);
+			CPRINTS_ERR("TCPC p%d init failed", port);
 #ifdef CONFIG_USB_PD_DUAL_ROLE_AUTO_TOGGLE
 	}
 
@@ -2522,7 +2633,7 @@ void pd_run_state_machine(int port)
 				break;
 			} else if (debug_level >= 2 &&
 					snk_cap_count == PD_SNK_CAP_RETRIES+1) {
-				CPRINTF("ERR SNK_CAP\n");
+				CPRINTF_WARN("ERR SNK_CAP\n");
 			}
 		}
 
@@ -2669,7 +2780,7 @@ void pd_run_state_machine(int port)
 #else
 		rstatus = tcpm_release(port);
 		if (rstatus != 0 && rstatus != EC_ERROR_UNIMPLEMENTED)
-			CPRINTS("TCPC p%d release failed!", port);
+			CPRINTS_ERR("TCPC p%d release failed!", port);
 #endif
 		/* Wait for resume */
 		// getting rid of task stuff
@@ -2682,7 +2793,7 @@ void pd_run_state_machine(int port)
 		if (rstatus != EC_ERROR_UNIMPLEMENTED &&
 			pd_restart_tcpc(port) != 0) {
 			/* stay in PD_STATE_SUSPENDED */
-			CPRINTS("TCPC p%d restart failed!", port);
+			CPRINTS_ERR("TCPC p%d restart failed!", port);
 			break;
 		}
 		set_state(port, PD_DEFAULT_STATE(port));
@@ -3481,7 +3592,7 @@ void pd_set_suspend(int port, int enable)
 			msleep(1);
 		} while (--tries != 0);
 		if (!tries)
-			CPRINTS("TCPC p%d set_suspend failed!", port);
+			CPRINTS_ERR("TCPC p%d set_suspend failed!", port);
 	} else {
 		if (pd[port].task_state != PD_STATE_SUSPENDED)
 			CPRINTS("TCPC p%d suspend disable request "
@@ -4179,7 +4290,7 @@ static int hc_remote_pd_set_amode(struct host_cmd_handler_args *args)
 			pd_send_vdm(p->port, p->svid,
 				    CMD_EXIT_MODE | VDO_OPOS(p->opos), NULL, 0);
 		else {
-			CPRINTF("Failed exit mode\n");
+			CPRINTF_ERR("Failed exit mode\n");
 			return EC_RES_ERROR;
 		}
 		break;
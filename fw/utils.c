@@ -24,10 +24,24 @@
 #include "lcd.h"
 #include "ui.h"
 #include "utils.h"
+#include "flashlog.h"
 
-void fatal(char *msg) {
+// Crash record and blue screen, everything fatal() does before it stops
+void fatal_report(char *msg) {
+    // A screen update cut short by its time slice may have left the LCD
+    // held, and nothing is going to finish it now
+    lcd_hold(false);
+    // The LCD DMA reads from flash too, let it finish before the XIP stops
+    while (lcd_is_busy())
+        lcd_poll();
+    flashlog_crash(msg);
     ui_clear(0x001f);
     ui_disp_string(0, 0, msg, 0xffff);
-    lcd_update();
-    while(1);
+    ui_update();
+}
+
+void fatal(char *msg) {
+    fatal_report(msg);
+    while(1)
+        lcd_poll();
 }
@@ -21,4 +21,5 @@
 //
 #pragma once
 
+void fatal_report(char *msg);
 void fatal(char *msg);
\ No newline at end of file
@@ -0,0 +1,132 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <stdint.h>
+#include "pico/stdlib.h"
+#include "hardware/watchdog.h"
+#include "wdog.h"
+
+#define WDOG_SCRATCH_CHECK  (0)
+#define WDOG_SCRATCH_CTX    (1)
+#define WDOG_SCRATCH_STATUS (3)
+
+// Longest time between check-ins, ms
+static const uint32_t wdog_limit_ms[WDOG_COUNT] = {
+    [WDOG_PD] = 100,
+    [WDOG_TCPC] = 100,
+    [WDOG_LCD] = 250,
+};
+
+static uint32_t wdog_last[WDOG_COUNT];
+static uint32_t wdog_start_time;
+static bool wdog_stable;
+// As found at boot
+static bool wdog_boot_reset;
+static uint32_t wdog_boot_status;
+static bool wdog_boot_valid;
+
+static uint32_t wdog_check(void) {
+    return WDOG_MAGIC ^ watchdog_hw->scratch[1] ^ watchdog_hw->scratch[2];
+}
+
+// Pick up what the previous boot left in the scratch registers
+void wdog_init(void) {
+    // Scratch registers keep their value over a watchdog reset only
+    wdog_boot_reset = watchdog_caused_reboot();
+    uint32_t status = watchdog_hw->scratch[WDOG_SCRATCH_STATUS];
+    wdog_boot_status = (wdog_boot_reset &&
+            ((status >> 16) == WDOG_STATUS_TAG)) ? status : 0;
+    wdog_boot_valid = wdog_boot_reset &&
+            (watchdog_hw->scratch[WDOG_SCRATCH_CHECK] == wdog_check());
+
+    // Only warm restarts count towards the limit
+    uint32_t warm = wdog_boot_valid ? ((wdog_boot_status >> 8) & 0xff) + 1 : 0;
+    watchdog_hw->scratch[WDOG_SCRATCH_STATUS] =
+            (WDOG_STATUS_TAG << 16) | (warm << 8);
+    watchdog_hw->scratch[WDOG_SCRATCH_CHECK] = 0;
+}
+
+// Arm the watchdog, from here on the main loop has to keep feeding it
+void wdog_start(void) {
+    uint32_t now = time_us_32();
+
+    for (int i = 0; i < WDOG_COUNT; i++)
+        wdog_last[i] = now;
+    wdog_start_time = now;
+    wdog_stable = false;
+    watchdog_enable(WDOG_TIMEOUT_MS, true);
+}
+
+void wdog_checkin(wdog_id_t id) {
+    wdog_last[id] = time_us_32();
+}
+
+// Feed the watchdog if every subsystem checked in recently enough. The ones
+// that did not are left in scratch for the next boot to report.
+void wdog_feed(void) {
+    uint32_t now = time_us_32();
+    uint32_t missed = 0;
+
+    for (int i = 0; i < WDOG_COUNT; i++)
+        if ((now - wdog_last[i]) > wdog_limit_ms[i] * 1000)
+            missed |= 1u << i;
+    if (missed) {
+        watchdog_hw->scratch[WDOG_SCRATCH_STATUS] |= missed;
+        return;
+    }
+    if (!wdog_stable && ((now - wdog_start_time) > WDOG_STABLE_MS * 1000)) {
+        wdog_stable = true;
+        watchdog_hw->scratch[WDOG_SCRATCH_STATUS] = WDOG_STATUS_TAG << 16;
+    }
+    watchdog_update();
+}
+
+// Save the context for a warm restart, NULL when there is nothing to keep.
+// The status word is left alone either way.
+void wdog_set_context(const uint32_t *ctx) {
+    if (!ctx) {
+        watchdog_hw->scratch[WDOG_SCRATCH_CHECK] = 0;
+        return;
+    }
+    for (int i = 0; i < WDOG_CTX_WORDS; i++)
+        watchdog_hw->scratch[WDOG_SCRATCH_CTX + i] = ctx[i];
+    watchdog_hw->scratch[WDOG_SCRATCH_CHECK] = wdog_check();
+}
+
+// Context saved before the watchdog reset, false on a cold start or when
+// the warm restarts came too often
+bool wdog_get_context(uint32_t *ctx) {
+    if (!wdog_boot_valid || (((wdog_boot_status >> 8) & 0xff) >= WDOG_MAX_WARM))
+        return false;
+    for (int i = 0; i < WDOG_CTX_WORDS; i++)
+        ctx[i] = watchdog_hw->scratch[WDOG_SCRATCH_CTX + i];
+    return true;
+}
+
+// True if the last reset was the watchdog's, with or without a context
+bool wdog_caused_reset(void) {
+    return wdog_boot_reset;
+}
+
+// Subsystems that missed their limit before the last reset
+uint32_t wdog_missed(void) {
+    return wdog_boot_status & 0xff;
+}
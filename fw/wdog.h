@@ -0,0 +1,67 @@
+//
+// Copyright 2021 Wenting Zhang <zephray@outlook.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Hardware watchdog fed from the main loop, but only while every subsystem
+// keeps checking in with wdog_checkin() within its own limit. A stalled loop
+// (an I2C hang in the TCPC driver, say) or a stuck subsystem stops the
+// feeding and the watchdog resets the chip.
+//
+// The reset is meant to be a warm restart. The main loop keeps the PD
+// contract and DP state in watchdog scratch registers, which survive the
+// watchdog reset, with wdog_set_context(). After the reset
+// wdog_get_context() hands them back, so the PD code can resync with a soft
+// reset instead of making the partner see a detach. Restarts that come too
+// quickly after each other fall back to a cold start.
+//
+// Scratch registers 4-7 belong to the SDK and the boot ROM:
+//   0: WDOG_MAGIC xor the context words, set while the context is valid
+//   1-2: context words
+//   3: status, valid on its own whether there is a context or not. Bits 0-7
+//      subsystems that missed their limit (none if the whole loop stalled),
+//      bits 8-15 warm restarts in a row, bits 16-31 WDOG_STATUS_TAG.
+
+#define WDOG_TIMEOUT_MS     (500)   // Above the worst flash sector erase
+#define WDOG_STABLE_MS      (10000) // Running this long clears the count
+#define WDOG_MAX_WARM       (3)     // Warm restarts in a row before a cold one
+#define WDOG_CTX_WORDS      (2)
+#define WDOG_MAGIC          (0x5741524d)    // "WARM"
+#define WDOG_STATUS_TAG     (0x5744)        // "WD"
+
+typedef enum {
+    WDOG_PD = 0,            // PD state machine ran
+    WDOG_TCPC,              // TCPC alert polled
+    WDOG_LCD,               // LCD idle or a frame completed
+    WDOG_COUNT
+} wdog_id_t;
+
+void wdog_init(void);
+void wdog_start(void);
+void wdog_checkin(wdog_id_t id);
+void wdog_feed(void);
+void wdog_set_context(const uint32_t *ctx);
+bool wdog_get_context(uint32_t *ctx);
+bool wdog_caused_reset(void);
+uint32_t wdog_missed(void);